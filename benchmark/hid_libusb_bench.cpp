@@ -0,0 +1,550 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2026 TU-Dresden  All rights reserved.
+//
+// Unless otherwise stated, the software on this site is distributed
+// in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+// without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. THERE IS NO WARRANTY FOR THE SOFTWARE,
+// TO THE EXTENT PERMITTED BY APPLICABLE LAW. EXCEPT WHEN OTHERWISE
+// STATED IN WRITING THE COPYRIGHT HOLDERS PROVIDE THE SOFTWARE
+// "AS IS" WITHOUT WARRANTY OF ANY KIND, EITHER EXPRESSED OR IMPLIED,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE ENTIRE
+// RISK AS TO THE QUALITY AND PERFORMANCE OF THE SOFTWARE IS WITH YOU.
+// SHOULD THE SOFTWARE PROVE DEFECTIVE, YOU ASSUME THE COST OF ALL
+// NECESSARY SERVICING, REPAIR OR CORRECTION. IN NO EVENT UNLESS
+// REQUIRED BY APPLICABLE LAW OR AGREED TO IN WRITING WILL ANY
+// COPYRIGHT HOLDER, BE LIABLE TO YOU FOR DAMAGES, INCLUDING ANY
+// GENERAL, SPECIAL, INCIDENTAL OR CONSEQUENTIAL DAMAGES ARISING OUT
+// OF THE USE OR INABILITY TO USE THE SOFTWARE (INCLUDING BUT NOT
+// LIMITED TO LOSS OF DATA OR DATA BEING RENDERED INACCURATE OR LOSSES
+// SUSTAINED BY YOU OR THIRD PARTIES OR A FAILURE OF THE SOFTWARE TO
+// OPERATE WITH ANY OTHER PROGRAMS), EVEN IF SUCH HOLDER HAS BEEN
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+//
+//-----------------------------------------------------------------
+
+// Company           :   TU-Dresden
+//
+// Filename          :   hid_libusb_bench.cpp
+// Project Name      :   PyHID
+// Description       :   Benchmark of the hid_libusb hot paths on mock devices
+//-----------------------------------------------------------------
+#include "pyhid/hid_libusb.hpp"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <string>
+#include <vector>
+
+// Usage: hid_libusb_bench [-t seconds] [-n devices] [-r rate] [-s size]
+//                         [scenario ...]
+//
+// Every scenario runs for the given time against mock devices (see
+// hid_mock_transport) and prints one line: reports per second, delivery
+// latency percentiles, drops, CPU and heap allocations per report.  The
+// latency is taken from the due time a mock device puts into each report
+// (or the send time a write puts into its echo) up to the return of the
+// reading call.
+//
+// The numbers are those of mock devices.  Their transfers complete
+// through the same callbacks, queues and write pipeline as those of a
+// real device, but libusb's event handling and the bus are not part of
+// them.
+
+#define BENCH_MAX_SAMPLES    (1 << 22)
+#define BENCH_BATCH_SIZE     64
+#define BENCH_READ_TIMEOUT   100
+
+// Global allocation counter.  The malloc family is replaced as well, so
+// the posix_memalign() of a report queue and whatever a capture or libusb
+// allocate are counted along with operator new.  glibc keeps the
+// originals as __libc_*.
+static std::atomic<uint64_t> g_uiAllocations(0);
+
+extern "C"
+{
+  void *__libc_malloc(size_t);
+  void *__libc_calloc(size_t, size_t);
+  void *__libc_realloc(void *, size_t);
+  void *__libc_memalign(size_t, size_t);
+  void  __libc_free(void *);
+
+  void *malloc(size_t uiSize) noexcept
+  {
+    g_uiAllocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(uiSize);
+  }
+
+  void *calloc(size_t uiCount, size_t uiSize) noexcept
+  {
+    g_uiAllocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(uiCount, uiSize);
+  }
+
+  void *realloc(void *p, size_t uiSize) noexcept
+  {
+    g_uiAllocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(p, uiSize);
+  }
+
+  void *memalign(size_t uiAlignment, size_t uiSize) noexcept
+  {
+    g_uiAllocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_memalign(uiAlignment, uiSize);
+  }
+
+  void *aligned_alloc(size_t uiAlignment, size_t uiSize) noexcept
+  {
+    return memalign(uiAlignment, uiSize);
+  }
+
+  int posix_memalign(void **pp, size_t uiAlignment, size_t uiSize) noexcept
+  {
+    if ( !uiAlignment || ( uiAlignment & ( uiAlignment - 1 ) ) ||
+         uiAlignment % sizeof(void *) )
+      return EINVAL;
+    void *p = memalign(uiAlignment, uiSize);
+    if ( !p )
+      return ENOMEM;
+    *pp = p;
+    return 0;
+  }
+
+  void free(void *p) noexcept
+  {
+    __libc_free(p);
+  }
+}
+
+void *operator new(size_t uiSize)
+{
+  void *p = malloc(uiSize ? uiSize : 1);
+  if ( !p )
+    throw std::bad_alloc();
+  return p;
+}
+
+void *operator new[](size_t uiSize)
+{
+  return operator new(uiSize);
+}
+
+void *operator new(size_t uiSize, const std::nothrow_t &) noexcept
+{
+  return malloc(uiSize ? uiSize : 1);
+}
+
+void *operator new[](size_t uiSize, const std::nothrow_t &tag) noexcept
+{
+  return operator new(uiSize, tag);
+}
+
+// GCC pairs the inlined std::allocator calls with malloc's free
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void *p) noexcept
+{
+  free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+  free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+  free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+  free(p);
+}
+#pragma GCC diagnostic pop
+
+typedef struct bench_options
+{
+  double    dSeconds;
+  size_t    uiDevices;
+  double    dRate;
+  size_t    uiReportSize;
+} bench_options_t;
+
+// what one reader thread saw
+typedef struct bench_reader
+{
+  hid_libusb               *pDevice;
+  size_t                    uiReportSize;
+  bool                      bBatch;
+  uint64_t                  uiReports;
+  uint64_t                  uiErrors;
+  std::vector<uint64_t>     latencies;
+} bench_reader_t;
+
+typedef struct bench_result
+{
+  uint64_t  uiReports;
+  uint64_t  uiDropped;
+  uint64_t  uiErrors;
+  double    dSeconds;
+  double    dCPUSeconds;
+  uint64_t  uiAllocations;
+  std::vector<uint64_t> latencies;
+} bench_result_t;
+
+static std::atomic<bool> g_bStop(false);
+
+static uint64_t getMonotonic()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static double getCPUSeconds()
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 +
+         usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+}
+
+// the due time of a mock report, or 0 if it is too short
+static uint64_t getDueTime(const uint8_t *puiData, const size_t uiLength)
+{
+  uint64_t uiDue = 0;
+  if ( uiLength >= 13 )
+    memcpy(&uiDue, puiData + 5, sizeof(uiDue));
+  return uiDue;
+}
+
+static void addLatency(bench_reader_t *pReader, const uint8_t *puiData,
+                       const size_t uiLength, const uint64_t uiNow)
+{
+  const uint64_t uiDue = getDueTime(puiData, uiLength);
+  if ( uiDue && pReader->latencies.size() < pReader->latencies.capacity() )
+    pReader->latencies.push_back(uiNow > uiDue ? uiNow - uiDue : 0);
+}
+
+static void *readThread(void *pParam)
+{
+  bench_reader_t *pReader = static_cast<bench_reader_t *>(pParam);
+
+  const size_t uiSize = pReader->uiReportSize;
+  std::vector<uint8_t> data(uiSize * BENCH_BATCH_SIZE);
+  size_t puiOffsets[BENCH_BATCH_SIZE];
+  size_t puiLengths[BENCH_BATCH_SIZE];
+  while ( !g_bStop.load(std::memory_order_relaxed) )
+    {
+      if ( pReader->bBatch )
+        {
+          const int iResult =
+            pReader->pDevice->readHIDBatch(data.data(), data.size(),
+                                           puiOffsets, puiLengths,
+                                           BENCH_BATCH_SIZE,
+                                           BENCH_READ_TIMEOUT);
+          if ( iResult < 0 )
+            {
+              pReader->uiErrors++;
+              break;
+            }
+          const uint64_t uiNow = getMonotonic();
+          for ( int i = 0; i < iResult; i++ )
+            addLatency(pReader, data.data() + puiOffsets[i], puiLengths[i],
+                       uiNow);
+          pReader->uiReports += iResult;
+        }
+      else
+        {
+          const int iResult = pReader->pDevice->readHID(data.data(), uiSize,
+                                                        BENCH_READ_TIMEOUT);
+          if ( iResult < 0 )
+            {
+              pReader->uiErrors++;
+              break;
+            }
+          if ( iResult > 0 )
+            {
+              addLatency(pReader, data.data(), iResult, getMonotonic());
+              pReader->uiReports++;
+            }
+        }
+    }
+
+  return 0;
+}
+
+static void reportCallback(hid_report_batch &batch, void *pUserData)
+{
+  bench_reader_t *pReader = static_cast<bench_reader_t *>(pUserData);
+
+  const uint64_t uiNow = getMonotonic();
+  for ( size_t i = 0; i < batch.size(); i++ )
+    addLatency(pReader, batch.getData().data() + batch.getOffsets()[i],
+               batch.getLengths()[i], uiNow);
+  pReader->uiReports += batch.size();
+}
+
+static void *echoThread(void *pParam)
+{
+  bench_reader_t *pReader = static_cast<bench_reader_t *>(pParam);
+
+  const size_t uiSize = pReader->uiReportSize;
+  std::vector<uint8_t> request(uiSize, 0);
+  std::vector<uint8_t> reply(uiSize);
+  uint32_t uiSequence = 0;
+  request[0] = 1;
+  while ( !g_bStop.load(std::memory_order_relaxed) )
+    {
+      const uint64_t uiNow = getMonotonic();
+      memcpy(request.data() + 1, &uiSequence, sizeof(uiSequence));
+      memcpy(request.data() + 5, &uiNow, sizeof(uiNow));
+      if ( pReader->pDevice->writeHID(request.data(), uiSize) < 0 )
+        {
+          pReader->uiErrors++;
+          break;
+        }
+      const int iResult = pReader->pDevice->readHID(reply.data(), uiSize,
+                                                    BENCH_READ_TIMEOUT);
+      if ( iResult <= 0 ||
+           memcmp(reply.data() + 1, &uiSequence, sizeof(uiSequence)) )
+        {
+          pReader->uiErrors++;
+          break;
+        }
+      addLatency(pReader, reply.data(), iResult, getMonotonic());
+      pReader->uiReports++;
+      uiSequence++;
+    }
+
+  return 0;
+}
+
+// Opens uiDevices mock devices, runs one thread per device for the
+// requested time, or lets the dispatcher call back, and sums up.
+static int runScenario(bench_options_t const& options, const size_t uiDevices,
+                       const double dRate, const hid_overflow_policy ePolicy,
+                       void *(*pThread)(void *), const bool bBatch,
+                       const bool bEcho, bench_result_t &result)
+{
+  std::vector<hid_libusb *> devices;
+  std::vector<bench_reader_t> readers(uiDevices);
+  int iResult = 0;
+  for ( size_t i = 0; i < uiDevices && !iResult; i++ )
+    {
+      hid_libusb *pDevice = new hid_libusb;
+      devices.push_back(pDevice);
+      pDevice->setOverflowPolicy(ePolicy);
+      readers[i].pDevice = pDevice;
+      readers[i].uiReportSize = options.uiReportSize;
+      readers[i].bBatch = bBatch;
+      readers[i].uiReports = 0;
+      readers[i].uiErrors = 0;
+      readers[i].latencies.reserve(BENCH_MAX_SAMPLES / uiDevices);
+      if ( !pThread )
+        pDevice->setReportCallback(reportCallback, &readers[i],
+                                   BENCH_BATCH_SIZE);
+      iResult = bEcho ?
+        pDevice->openMock(0, options.uiReportSize, 0, 0, true) :
+        pDevice->openMock(dRate, options.uiReportSize, 0,
+                          HID_MOCK_UNLIMITED, false);
+    }
+
+  std::vector<pthread_t> threads;
+  const uint64_t uiAllocations = g_uiAllocations.load();
+  const double dCPU = getCPUSeconds();
+  const uint64_t uiStart = getMonotonic();
+  g_bStop = false;
+  for ( size_t i = 0; i < readers.size() && !iResult && pThread; i++ )
+    {
+      pthread_t thread;
+      if ( pthread_create(&thread, 0, pThread, &readers[i]) )
+        {
+          iResult = HID_LIBUSB_INVALID_ARGS;
+          break;
+        }
+      threads.push_back(thread);
+    }
+
+  if ( !iResult )
+    usleep(options.dSeconds * 1e6);
+  g_bStop = true;
+  for ( size_t i = 0; i < threads.size(); i++ )
+    pthread_join(threads[i], 0);
+  for ( size_t i = 0; i < devices.size(); i++ )
+    {
+      // stops the callbacks as well
+      devices[i]->closeHID();
+    }
+
+  result.dSeconds = ( getMonotonic() - uiStart ) * 1e-9;
+  result.dCPUSeconds = getCPUSeconds() - dCPU;
+  result.uiAllocations = g_uiAllocations.load() - uiAllocations;
+  result.uiReports = 0;
+  result.uiDropped = 0;
+  result.uiErrors = 0;
+  result.latencies.clear();
+  for ( size_t i = 0; i < readers.size(); i++ )
+    {
+      result.uiReports += readers[i].uiReports;
+      result.uiErrors += readers[i].uiErrors;
+      result.uiDropped += devices[i]->getDroppedReports();
+      result.latencies.insert(result.latencies.end(),
+                              readers[i].latencies.begin(),
+                              readers[i].latencies.end());
+      delete devices[i];
+    }
+
+  return iResult;
+}
+
+static double getPercentile(std::vector<uint64_t> &latencies,
+                            const double dPercentile)
+{
+  if ( latencies.empty() )
+    return 0;
+  const size_t uiIndex = std::min(latencies.size() - 1,
+                                  (size_t)( latencies.size() * dPercentile / 100 ));
+  std::nth_element(latencies.begin(), latencies.begin() + uiIndex,
+                   latencies.end());
+  return latencies[uiIndex] * 1e-3;
+}
+
+static void printResult(const char *szName, bench_result_t &result)
+{
+  const double dReports = result.uiReports ? result.uiReports : 1;
+  const double dP50 = getPercentile(result.latencies, 50);
+  const double dP99 = getPercentile(result.latencies, 99);
+  const double dP999 = getPercentile(result.latencies, 99.9);
+  printf("%-14s %12.0f %10.1f %10.1f %10.1f %10llu %10.0f %10.3f\n",
+         szName, result.uiReports / result.dSeconds, dP50, dP99, dP999,
+         (unsigned long long)result.uiDropped,
+         result.dCPUSeconds * 1e9 / dReports,
+         result.uiAllocations / dReports);
+  if ( result.uiErrors )
+    printf("%-14s %llu reader(s) failed\n", szName,
+           (unsigned long long)result.uiErrors);
+}
+
+static void usage(const char *szProgram)
+{
+  fprintf(stderr,
+          "usage: %s [-t seconds] [-n devices] [-r rate] [-s size] [scenario ...]\n"
+          "scenarios: read read-batch read-paced write-echo many-read many-callback\n",
+          szProgram);
+}
+
+int main(int argc, char **argv)
+{
+  bench_options_t options;
+  options.dSeconds = 2;
+  options.uiDevices = 16;
+  options.dRate = 8000;
+  options.uiReportSize = 64;
+
+  int iOption;
+  while ( ( iOption = getopt(argc, argv, "t:n:r:s:h") ) != -1 )
+    {
+      switch ( iOption )
+        {
+        case 't':
+          options.dSeconds = atof(optarg);
+          break;
+        case 'n':
+          options.uiDevices = strtoul(optarg, 0, 0);
+          break;
+        case 'r':
+          options.dRate = atof(optarg);
+          break;
+        case 's':
+          options.uiReportSize = strtoul(optarg, 0, 0);
+          break;
+        default:
+          usage(argv[0]);
+          return 1;
+        }
+    }
+  if ( !( options.dSeconds > 0 ) || !options.uiDevices ||
+       !( options.dRate > 0 ) )
+    {
+      usage(argv[0]);
+      return 1;
+    }
+  if ( options.uiReportSize < 13 )
+    {
+      fprintf(stderr, "%s: reports need at least 13 bytes for the latency\n",
+              argv[0]);
+      return 1;
+    }
+
+  std::vector<std::string> scenarios(argv + optind, argv + argc);
+  if ( scenarios.empty() )
+    {
+      scenarios.push_back("read");
+      scenarios.push_back("read-batch");
+      scenarios.push_back("read-paced");
+      scenarios.push_back("write-echo");
+      scenarios.push_back("many-read");
+      scenarios.push_back("many-callback");
+    }
+
+  printf("%-14s %12s %10s %10s %10s %10s %10s %10s\n", "scenario",
+         "reports/s", "p50 us", "p99 us", "p99.9 us", "dropped",
+         "cpu ns", "allocs");
+  int iFailed = 0;
+  for ( size_t i = 0; i < scenarios.size(); i++ )
+    {
+      std::string const& name = scenarios[i];
+      bench_result_t result;
+      int iResult;
+      if ( name == "read" )
+        iResult = runScenario(options, 1, 0, HID_OVERFLOW_BLOCK,
+                              readThread, false, false, result);
+      else if ( name == "read-batch" )
+        iResult = runScenario(options, 1, 0, HID_OVERFLOW_BLOCK,
+                              readThread, true, false, result);
+      else if ( name == "read-paced" )
+        iResult = runScenario(options, 1, options.dRate,
+                              HID_OVERFLOW_DROP_OLDEST,
+                              readThread, false, false, result);
+      else if ( name == "write-echo" )
+        iResult = runScenario(options, 1, 0, HID_OVERFLOW_BLOCK,
+                              echoThread, false, true, result);
+      else if ( name == "many-read" )
+        iResult = runScenario(options, options.uiDevices, options.dRate,
+                              HID_OVERFLOW_DROP_OLDEST,
+                              readThread, false, false, result);
+      else if ( name == "many-callback" )
+        iResult = runScenario(options, options.uiDevices, options.dRate,
+                              HID_OVERFLOW_DROP_OLDEST,
+                              0, false, false, result);
+      else
+        {
+          usage(argv[0]);
+          return 1;
+        }
+
+      if ( iResult < 0 )
+        {
+          fprintf(stderr, "%s: %s failed (%d)\n", argv[0], name.c_str(),
+                  iResult);
+          iFailed = 1;
+          continue;
+        }
+      printResult(name.c_str(), result);
+    }
+
+  return iFailed;
+}
@@ -0,0 +1,294 @@
+#!/usr/bin/env python
+"""
+Benchmark of the Python API of the pyhid module against mock devices,
+see hid_libusb::openMock().  Every case calls one binding in a loop for
+a fixed time and reports calls/s, ns per call and ns per byte as JSON.
+
+  python benchmark/pyhid_bench.py -o result.json
+  python benchmark/pyhid_bench.py --baseline result.json
+
+With --baseline the run fails if a case got slower per call by more than
+--threshold, which catches regressions in the binding layer.
+"""
+import argparse
+import json
+import platform
+import sys
+import threading
+import time
+
+import pyhid
+
+BATCH = 64
+TIMEOUT = 1000
+
+
+def open_reader(size, policy=None):
+    # unpaced input reports without echo, as fast as they are read
+    device = pyhid.pyhidaccess()
+    if policy is not None:
+        check(device.setOverflowPolicy(policy), "setOverflowPolicy")
+    check(device.openMock(0, size, 0, 0xffffffffffffffff, False), "openMock")
+    return device
+
+
+def open_echo(size, policy=None):
+    # no input reports of its own, every write comes back
+    device = pyhid.pyhidaccess()
+    if policy is not None:
+        check(device.setOverflowPolicy(policy), "setOverflowPolicy")
+    check(device.openMock(0, size, 0, 0, True), "openMock")
+    return device
+
+
+def check(ret, call):
+    if ret < 0:
+        raise RuntimeError("%s failed with %d" % (call, ret))
+
+
+def request(size):
+    return bytes([0x42] + [0] * (size - 1))
+
+
+# Each case returns (device, call) where call() does one operation and
+# returns the number of reports and bytes it moved.
+
+def case_read(size):
+    device = open_reader(size, pyhid.hid_overflow_policy.HID_OVERFLOW_BLOCK)
+    read = device.readHID
+
+    def call():
+        return 1, len(read(size, TIMEOUT))
+    return device, call
+
+
+def case_read_nowait(size):
+    device = open_reader(size)
+    read = device.readHID
+
+    def call():
+        report = read(size, 0)
+        return (1 if report else 0), len(report)
+    return device, call
+
+
+def case_read_timestamped(size):
+    device = open_reader(size, pyhid.hid_overflow_policy.HID_OVERFLOW_BLOCK)
+    read = device.readHIDTimestamped
+
+    def call():
+        report, timestamp = read(size, TIMEOUT)
+        return 1, len(report)
+    return device, call
+
+
+def case_read_into(size):
+    device = open_reader(size, pyhid.hid_overflow_policy.HID_OVERFLOW_BLOCK)
+    read = device.readHIDInto
+    buffer = bytearray(size)
+
+    def call():
+        return 1, read(buffer, TIMEOUT)
+    return device, call
+
+
+def case_read_batch(size):
+    device = open_reader(size, pyhid.hid_overflow_policy.HID_OVERFLOW_BLOCK)
+    read = device.readHIDBatch
+
+    def call():
+        batch = read(BATCH, TIMEOUT)
+        return len(batch), len(batch.data)
+    return device, call
+
+
+def case_write_bytes(size):
+    device = open_echo(size)
+    write = device.writeHID
+    report = request(size)
+
+    def call():
+        return 1, write(report)
+    return device, call
+
+
+def case_write_list(size):
+    device = open_echo(size)
+    write = device.writeHID
+    report = list(request(size))
+
+    def call():
+        return 1, write(report)
+    return device, call
+
+
+def case_write_read(size):
+    device = open_echo(size, pyhid.hid_overflow_policy.HID_OVERFLOW_BLOCK)
+    write = device.writeHID
+    read = device.readHID
+    report = request(size)
+
+    def call():
+        write(report)
+        return 1, len(read(size, TIMEOUT))
+    return device, call
+
+
+def case_transact(size):
+    device = open_echo(size)
+    transact = device.transactHID
+    matcher = pyhid.reportmatcher.reportID(0x42)
+    report = request(size)
+
+    def call():
+        return 1, len(transact(report, matcher, size, TIMEOUT))
+    return device, call
+
+
+CASES = [
+    ("readHID", case_read),
+    ("readHID_nowait", case_read_nowait),
+    ("readHIDTimestamped", case_read_timestamped),
+    ("readHIDInto", case_read_into),
+    ("readHIDBatch", case_read_batch),
+    ("writeHID_bytes", case_write_bytes),
+    ("writeHID_list", case_write_list),
+    ("writeHID_readHID", case_write_read),
+    ("transactHID", case_transact),
+]
+
+
+def run_loop(name, setup, size, duration):
+    device, call = setup(size)
+    try:
+        calls = reports = nbytes = 0
+        start = time.perf_counter()
+        end = start + duration
+        now = start
+        while now < end:
+            # check the clock once per 64 calls only
+            for _ in range(64):
+                n, b = call()
+                reports += n
+                nbytes += b
+            calls += 64
+            now = time.perf_counter()
+        elapsed = now - start
+    finally:
+        device.closeHID()
+    return result(name, size, calls, reports, nbytes, elapsed)
+
+
+def run_callback(size, duration):
+    # reports pushed to a Python callable by the dispatcher thread
+    device = open_reader(size, pyhid.hid_overflow_policy.HID_OVERFLOW_BLOCK)
+    counts = [0, 0, 0]
+    lock = threading.Lock()
+
+    def callback(batch):
+        with lock:
+            counts[0] += 1
+            counts[1] += len(batch)
+            counts[2] += len(batch.data)
+
+    try:
+        start = time.perf_counter()
+        device.setReportCallback(callback, BATCH)
+        time.sleep(duration)
+        device.setReportCallback(None)
+        elapsed = time.perf_counter() - start
+    finally:
+        device.closeHID()
+    with lock:
+        return result("setReportCallback", size, counts[0], counts[1], counts[2], elapsed)
+
+
+def result(name, size, calls, reports, nbytes, elapsed):
+    return {
+        "name": name,
+        "report_size": size,
+        "calls": calls,
+        "reports": reports,
+        "bytes": nbytes,
+        "seconds": elapsed,
+        "calls_per_s": calls / elapsed if elapsed else 0.0,
+        "reports_per_s": reports / elapsed if elapsed else 0.0,
+        "ns_per_call": elapsed * 1e9 / calls if calls else 0.0,
+        "ns_per_byte": elapsed * 1e9 / nbytes if nbytes else 0.0,
+    }
+
+
+def compare(results, baseline, threshold):
+    # returns the cases that got slower per call than allowed
+    old = dict(((r["name"], r["report_size"]), r) for r in baseline["results"])
+    slower = []
+    for r in results:
+        base = old.get((r["name"], r["report_size"]))
+        if not base or not base["ns_per_call"]:
+            continue
+        ratio = r["ns_per_call"] / base["ns_per_call"]
+        r["baseline_ratio"] = ratio
+        if ratio > 1.0 + threshold:
+            slower.append("%s/%d" % (r["name"], r["report_size"]))
+    return slower
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("-t", "--duration", type=float, default=1.0,
+                        help="seconds per case")
+    parser.add_argument("-s", "--size", type=int, action="append",
+                        help="report size in bytes, may be given more than once")
+    parser.add_argument("-o", "--output", help="write the JSON here instead of stdout")
+    parser.add_argument("--baseline", help="JSON of an earlier run to compare with")
+    parser.add_argument("--threshold", type=float, default=0.2,
+                        help="allowed slowdown per call against the baseline")
+    parser.add_argument("cases", nargs="*",
+                        help="cases to run, all by default: %s, setReportCallback"
+                        % ", ".join(name for name, _ in CASES))
+    args = parser.parse_args()
+
+    known = [name for name, _ in CASES] + ["setReportCallback"]
+    for name in args.cases:
+        if name not in known:
+            parser.error("unknown case %s" % name)
+    selected = args.cases or known
+
+    results = []
+    for size in args.size or [64]:
+        for name, setup in CASES:
+            if name in selected:
+                results.append(run_loop(name, setup, size, args.duration))
+        if "setReportCallback" in selected:
+            results.append(run_callback(size, args.duration))
+
+    report = {
+        "python": platform.python_version(),
+        "platform": platform.platform(),
+        "module": getattr(pyhid, "__file__", ""),
+        "duration": args.duration,
+        "results": results,
+    }
+
+    slower = []
+    if args.baseline:
+        with open(args.baseline) as f:
+            slower = compare(results, json.load(f), args.threshold)
+        report["regressions"] = slower
+
+    text = json.dumps(report, indent=2, sort_keys=True)
+    if args.output:
+        with open(args.output, "w") as f:
+            f.write(text + "\n")
+    else:
+        print(text)
+
+    if slower:
+        sys.stderr.write("slower than the baseline: %s\n" % ", ".join(slower))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
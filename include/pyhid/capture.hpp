@@ -0,0 +1,228 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2026 TU-Dresden  All rights reserved.
+//
+// Unless otherwise stated, the software on this site is distributed
+// in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+// without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. THERE IS NO WARRANTY FOR THE SOFTWARE,
+// TO THE EXTENT PERMITTED BY APPLICABLE LAW. EXCEPT WHEN OTHERWISE
+// STATED IN WRITING THE COPYRIGHT HOLDERS PROVIDE THE SOFTWARE
+// "AS IS" WITHOUT WARRANTY OF ANY KIND, EITHER EXPRESSED OR IMPLIED,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE ENTIRE
+// RISK AS TO THE QUALITY AND PERFORMANCE OF THE SOFTWARE IS WITH YOU.
+// SHOULD THE SOFTWARE PROVE DEFECTIVE, YOU ASSUME THE COST OF ALL
+// NECESSARY SERVICING, REPAIR OR CORRECTION. IN NO EVENT UNLESS
+// REQUIRED BY APPLICABLE LAW OR AGREED TO IN WRITING WILL ANY
+// COPYRIGHT HOLDER, BE LIABLE TO YOU FOR DAMAGES, INCLUDING ANY
+// GENERAL, SPECIAL, INCIDENTAL OR CONSEQUENTIAL DAMAGES ARISING OUT
+// OF THE USE OR INABILITY TO USE THE SOFTWARE (INCLUDING BUT NOT
+// LIMITED TO LOSS OF DATA OR DATA BEING RENDERED INACCURATE OR LOSSES
+// SUSTAINED BY YOU OR THIRD PARTIES OR A FAILURE OF THE SOFTWARE TO
+// OPERATE WITH ANY OTHER PROGRAMS), EVEN IF SUCH HOLDER HAS BEEN
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+//
+//-----------------------------------------------------------------
+
+// Company           :   TU-Dresden
+//
+// Filename          :   capture.hpp
+// Project Name      :   PyHID
+// Description       :   Binary capture of device traffic
+//-----------------------------------------------------------------
+#ifndef __CAPTURE_HPP__
+#define __CAPTURE_HPP__
+
+#include <stdint.h>
+#include <cstddef>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <genpybind.h>
+
+#define HID_CAPTURE_DEFAULT_BUFFER  (4 << 20)
+#define HID_CAPTURE_INDEX_INTERVAL  (64 << 10)
+#define HID_CAPTURE_FLUSH_MS        100
+#define HID_CAPTURE_VERSION         1
+
+// Capture file layout, all integers in host byte order:
+//
+//   capture_file_header_t
+//   records, each a capture_record_t followed by its payload, padded to
+//            a multiple of 8 bytes
+//   HID_CAPTURE_DEVICE records of all devices, once more
+//   capture_index_entry_t[uiEntries]
+//   capture_trailer_t
+//
+// A HID_CAPTURE_DEVICE record announces device uiDevice before any of
+// its reports, its payload is a capture_device_t followed by the serial
+// number.  The copies in front of the index let a reader seek without
+// scanning for them.  Every HID_CAPTURE_INDEX_INTERVAL bytes the index
+// points at the report record starting there.  Records are in the order
+// they were recorded, which is the order of their timestamps for the
+// reports of one device.  All timestamps are CLOCK_MONOTONIC, whatever
+// clock the devices stamp their reports with.
+// The index and the trailer are missing if the capture was never closed,
+// the records can still be read front to back.
+
+enum GENPYBIND(visible) hid_capture_kind
+{
+  HID_CAPTURE_INPUT       = 0,
+  HID_CAPTURE_OUTPUT      = 1,
+  HID_CAPTURE_FEATURE_OUT = 2,
+  HID_CAPTURE_FEATURE_IN  = 3,
+  HID_CAPTURE_DEVICE      = 4
+};
+
+typedef struct capture_file_header
+{
+  char                 szMagic[8];      // "PYHIDCAP"
+  uint32_t             uiVersion;
+  uint32_t             uiHeaderSize;
+} capture_file_header_t;
+
+typedef struct capture_record
+{
+  uint32_t             uiSize;          // header and payload, without padding
+  uint16_t             uiDevice;
+  uint8_t              uiKind;
+  uint8_t              uiReserved;
+  uint64_t             uiTimestamp;
+} capture_record_t;
+
+typedef struct capture_device
+{
+  uint16_t             uiVendorID;
+  uint16_t             uiProductID;
+  uint16_t             uiBusNumber;
+  uint16_t             uiDeviceAddress;
+  int32_t              iInterfaceNumber;
+} capture_device_t;
+
+typedef struct capture_index_entry
+{
+  uint64_t             uiTimestamp;
+  uint64_t             uiOffset;
+} capture_index_entry_t;
+
+typedef struct capture_trailer
+{
+  uint64_t             uiIndexOffset;
+  uint64_t             uiEntries;
+  uint64_t             uiDevicesOffset;
+  uint64_t             uiDevices;
+  char                 szMagic[8];      // "PYHIDIDX"
+} capture_trailer_t;
+
+// Records device traffic into a capture file.  record() is called from
+// the libusb event thread and from writing threads, it never blocks: the
+// record is copied into a ring that a writer thread drains into the file
+// in large writes.  A record that does not fit into the ring is dropped
+// and counted.
+class GENPYBIND(visible, expose_as(capture)) hid_capture
+{
+private:
+
+  typedef class hid_capture self_type_t;
+
+  // written by the producers and by the writer, keep them apart
+  std::atomic<uint64_t>           m_uiReserved;
+  char                            m_cPadReserved[64 - sizeof(uint64_t)];
+  std::atomic<uint64_t>           m_uiFlushed;
+  char                            m_cPadFlushed[64 - sizeof(uint64_t)];
+  std::atomic<int>                m_iProducers;
+  std::atomic<bool>               m_bOpen;
+  std::atomic<bool>               m_bStopWriter;
+  std::atomic<uint64_t>           m_uiRecords;
+  std::atomic<uint64_t>           m_uiDropped;
+  std::atomic<uint64_t>           m_uiBytesWritten;
+  uint8_t                        *m_puiRing;
+  size_t                          m_uiCapacity;
+  int                             m_iFile;
+  int                             m_iWakeFd;
+  int                             m_iError;
+  pthread_t                       m_Writer;
+  pthread_mutex_t                 m_Mutex;
+  std::vector<std::vector<uint8_t> > m_Devices;
+  std::vector<capture_index_entry_t> m_Index;
+  uint64_t                        m_uiIndexed;
+
+  bool append(const uint16_t, const uint8_t, const uint64_t,
+              const uint8_t *, size_t);
+  void copyIn(const uint64_t, const void *, size_t);
+  void copyOut(const uint64_t, void *, size_t) const;
+  void wakeWriter();
+  void flush();
+  static void *writerThread(void *);
+
+  hid_capture(const hid_capture &);
+  hid_capture &operator=(const hid_capture &);
+
+public:
+
+  hid_capture();
+  ~hid_capture();
+
+  int open(std::string const& path,
+           const size_t uiBufferSize = HID_CAPTURE_DEFAULT_BUFFER)
+    GENPYBIND(hidden);
+  int close() GENPYBIND(hidden);
+  bool isOpen() const;
+
+  // Announces a device, the returned id goes into record().  Devices are
+  // remembered across open() calls.
+  int addDevice(const uint16_t uiVendorID, const uint16_t uiProductID,
+                const uint16_t uiBusNumber, const uint16_t uiDeviceAddress,
+                const int32_t iInterfaceNumber, const char *szSerial)
+    GENPYBIND(hidden);
+  bool record(const uint16_t uiDevice, const hid_capture_kind eKind,
+              const uint64_t uiTimestamp, const uint8_t *puiData,
+              size_t uiLength) GENPYBIND(hidden);
+
+  uint64_t getRecords() const;
+  uint64_t getDroppedRecords() const;
+  uint64_t getBytesWritten() const;
+
+  // open() and close() without the GIL
+  GENPYBIND_MANUAL({
+    pyhid_python::bindCapture(parent);
+  })
+};
+
+// Reads a capture file front to back in large chunks.  seek() uses the
+// time index of a closed capture.
+class hid_capture_reader
+{
+private:
+
+  typedef class hid_capture_reader self_type_t;
+
+  int                             m_iFile;
+  std::vector<uint8_t>            m_Buffer;
+  size_t                          m_uiBegin;
+  size_t                          m_uiEnd;
+  uint64_t                        m_uiOffset;
+  uint64_t                        m_uiRecordsEnd;
+  std::vector<capture_index_entry_t> m_Index;
+
+  int fill(const size_t);
+
+  hid_capture_reader(const hid_capture_reader &);
+  hid_capture_reader &operator=(const hid_capture_reader &);
+
+public:
+
+  hid_capture_reader();
+  ~hid_capture_reader();
+
+  int open(std::string const& path);
+  void close();
+  // 1 and the next record, 0 at the end of the records
+  int read(capture_record_t &record, std::vector<uint8_t> &payload);
+  // continues at the last indexed record not later than uiTimestamp
+  int seek(const uint64_t uiTimestamp);
+};
+
+#endif
@@ -0,0 +1,145 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2026 TU-Dresden  All rights reserved.
+//
+// Unless otherwise stated, the software on this site is distributed
+// in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+// without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. THERE IS NO WARRANTY FOR THE SOFTWARE,
+// TO THE EXTENT PERMITTED BY APPLICABLE LAW. EXCEPT WHEN OTHERWISE
+// STATED IN WRITING THE COPYRIGHT HOLDERS PROVIDE THE SOFTWARE
+// "AS IS" WITHOUT WARRANTY OF ANY KIND, EITHER EXPRESSED OR IMPLIED,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE ENTIRE
+// RISK AS TO THE QUALITY AND PERFORMANCE OF THE SOFTWARE IS WITH YOU.
+// SHOULD THE SOFTWARE PROVE DEFECTIVE, YOU ASSUME THE COST OF ALL
+// NECESSARY SERVICING, REPAIR OR CORRECTION. IN NO EVENT UNLESS
+// REQUIRED BY APPLICABLE LAW OR AGREED TO IN WRITING WILL ANY
+// COPYRIGHT HOLDER, BE LIABLE TO YOU FOR DAMAGES, INCLUDING ANY
+// GENERAL, SPECIAL, INCIDENTAL OR CONSEQUENTIAL DAMAGES ARISING OUT
+// OF THE USE OR INABILITY TO USE THE SOFTWARE (INCLUDING BUT NOT
+// LIMITED TO LOSS OF DATA OR DATA BEING RENDERED INACCURATE OR LOSSES
+// SUSTAINED BY YOU OR THIRD PARTIES OR A FAILURE OF THE SOFTWARE TO
+// OPERATE WITH ANY OTHER PROGRAMS), EVEN IF SUCH HOLDER HAS BEEN
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+//
+//-----------------------------------------------------------------
+
+// Company           :   TU-Dresden
+//
+// Filename          :   device_registry.hpp
+// Project Name      :   PyHID
+// Description       :   Process wide index of HID interfaces
+//-----------------------------------------------------------------
+#ifndef __DEVICE_REGISTRY_HPP__
+#define __DEVICE_REGISTRY_HPP__
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <pthread.h>
+#include <libusb.h>
+
+struct hid_device_info;
+
+// Identity of one HID interface.  The serial is empty if the device has
+// none or it could not be read.
+typedef struct hid_registry_key
+{
+  uint16_t    uiVendorID;
+  uint16_t    uiProductID;
+  std::string serial;
+  uint16_t    uiBusNumber;
+  uint16_t    uiDeviceAddress;
+  int32_t     iInterfaceNumber;
+
+  bool operator==(const struct hid_registry_key &other) const;
+} hid_registry_key_t;
+
+struct hid_registry_hash
+{
+  size_t operator()(const hid_registry_key_t &key) const;
+};
+
+// Every HID interface libusb sees, indexed by (VID, PID, serial, bus,
+// address, interface) and by (VID, PID, serial).  libusb hotplug events
+// only queue the devices that came or left, they are looked at by the
+// next lookup, so no descriptor is read on the event thread.  A device
+// is opened once for its serial, by the first lookup of its VID and PID
+// and without the mutex, only then it is indexed.  Without hotplug
+// support attach() fails and hid_libusb enumerates like before.
+class hid_device_registry
+{
+private:
+
+  typedef class hid_device_registry self_type_t;
+  typedef std::unordered_map<hid_registry_key_t, libusb_device *,
+                             hid_registry_hash> interfaces_t;
+  typedef std::unordered_map<hid_registry_key_t,
+                             std::vector<hid_registry_key_t>,
+                             hid_registry_hash> serials_t;
+  // the HID interfaces of one device, their serial is filled in once it
+  // was read
+  typedef struct hid_registry_device
+  {
+    std::vector<hid_registry_key_t> keys;
+    uint8_t                         uiSerialIndex;
+    bool                            bIndexed;
+    bool                            bReading;
+  } hid_registry_device_t;
+  typedef std::unordered_map<libusb_device *,
+                             hid_registry_device_t> devices_t;
+  // a referenced device and whether it arrived or left
+  typedef std::pair<libusb_device *, bool> hid_registry_event_t;
+
+  libusb_context                   *m_pContext;
+  bool                              m_bAttached;
+  libusb_hotplug_callback_handle    m_Callback;
+  // guards the indexes, released while devices are opened for their
+  // serial
+  pthread_mutex_t                   m_Mutex;
+  // signalled when serials were read, with m_Mutex
+  pthread_cond_t                    m_SerialCondition;
+  // guards the events only, taken on the event thread
+  pthread_mutex_t                   m_EventMutex;
+  std::vector<hid_registry_event_t> m_Events;
+  interfaces_t                      m_Interfaces;
+  serials_t                         m_Serials;
+  devices_t                         m_Devices;
+
+  static int hotplugCallback(libusb_context *, libusb_device *,
+                             libusb_hotplug_event, void *);
+  void update();
+  void addDevice(libusb_device *);
+  void removeDevice(libusb_device *);
+  void readSerials(const uint16_t, const uint16_t);
+  void indexDevice(hid_registry_device_t &, libusb_device *);
+  static std::string readSerial(libusb_device *, const uint8_t);
+
+  hid_device_registry();
+  hid_device_registry(const hid_device_registry &);
+  hid_device_registry &operator=(const hid_device_registry &);
+
+public:
+
+  ~hid_device_registry();
+  static hid_device_registry &getInstance();
+
+  // Starts to follow the devices of pContext, true if it does already.
+  bool attach(libusb_context *pContext);
+  // Forgets all devices, called before the context goes away.
+  void detach();
+  // The registered device of the interface pDevice describes, referenced
+  // for the caller, or 0.
+  libusb_device *findDevice(const struct hid_device_info *pDevice);
+  // Fills the VID, PID, bus, address and interface of the lowest HID
+  // interface with the serial into *pDevice, the strings are left 0.
+  int findSerial(const uint16_t uiVendorID, const uint16_t uiProductID,
+                 std::string const& serial, struct hid_device_info *pDevice);
+  size_t size();
+};
+
+#endif
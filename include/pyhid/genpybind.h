@@ -3,3 +3,7 @@
 GENPYBIND_MANUAL({ parent.attr("__variant__") = "pybind11"; })
 
 #include "pyhid/hid_libusb.hpp"
+
+#if defined(__GENPYBIND_GENERATED__)
+#include "pyhid/python_bindings.hpp"
+#endif
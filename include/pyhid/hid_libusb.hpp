@@ -42,7 +42,11 @@
 
 #include <stdint.h>
 #include <cstddef>
+#include <atomic>
+#include <future>
+#include <set>
 #include <string>
+#include <utility>
 #include <vector>
 #include <genpybind.h>
 
@@ -54,6 +58,13 @@
 #define HID_LIBUSB_UDEV_MON_ERROR -1005
 #define HID_LIBUSB_UDEV_TIMEOUT   -1006
 #define HID_LIBUSB_NO_LIBUSB      -1007
+#define HID_LIBUSB_DEVICE_BUSY    -1008
+#define HID_LIBUSB_FILE_ERROR     -1009
+
+#define HID_LIBUSB_DEFAULT_TRANSFER_DEPTH 4
+#define HID_LIBUSB_EVENT_TIMEOUT_MS       250
+#define HID_LIBUSB_DEFAULT_TRANSACTION_WINDOW 8
+#define HID_LIBUSB_DEFAULT_CALLBACK_BATCH     64
 
 typedef struct hid_device_info
 {
@@ -69,16 +80,57 @@ typedef struct hid_device_info
   struct hid_device_info *pNext;
 } hid_device_info_t;
 
-typedef struct input_report
-{
-  uint8_t             *puiData;
-  size_t               uiLength;
-  struct input_report *pNext;
-} input_report_t;
-
 #include <pthread.h>
 #include <libusb.h>
 
+#include "pyhid/report_queue.hpp"
+#include "pyhid/write_queue.hpp"
+#include "pyhid/report_matcher.hpp"
+#include "pyhid/capture.hpp"
+#include "pyhid/transport.hpp"
+
+// One of the interrupt OUT transfers writeHIDAsync() reports are drained
+// into, reused for the lifetime of the open device.
+typedef struct output_transfer
+{
+  class hid_libusb       *pDevice;
+  struct libusb_transfer *pTransfer;
+  write_request_t        *pRequest;
+  struct output_transfer *pNext;
+} output_transfer_t;
+
+// Completion handler of hid_libusb::submitTransaction(), called on the
+// libusb event thread with the reply length, the reply (only valid during
+// the call) and its timestamp.  On failure it gets a negative error code
+// and no reply, possibly from within closeHID().
+typedef void (*hid_transaction_callback_t)(int, const uint8_t *, size_t,
+                                           uint64_t, void *);
+
+// Input report predicate, called on the libusb event thread before a
+// report is queued.  Returning false discards the report.
+typedef bool (*hid_input_predicate_t)(const uint8_t *, size_t, void *);
+
+// Immutable set of input filters, replaced as a whole whenever it
+// changes.  Replaced sets are kept on a retire chain until the filter
+// epoch shows that the event thread cannot be looking at them anymore.
+typedef struct hid_input_filter
+{
+  std::vector<hid_report_matcher> drops;
+  hid_input_predicate_t           pPredicate;
+  void                           *pUserData;
+  uint64_t                        uiRetiredEpoch;
+  struct hid_input_filter        *pRetired;
+} hid_input_filter_t;
+
+typedef struct hid_transaction
+{
+  hid_report_matcher          matcher;
+  hid_transaction_callback_t  pCallback;
+  void                       *pUserData;
+  uint64_t                    uiSequence;
+  int                         iId;
+} hid_transaction_t;
+
 class libusb_wrapper
 {
 private:
@@ -112,6 +164,9 @@ private:
                                                       uint8_t,
                                                       unsigned char *, int);
   typedef int     (*libusbHandleEvents_t)(libusb_context *);
+  typedef int     (*libusbHandleEventsTimeout_t)(libusb_context *,
+                                                 struct timeval *);
+  typedef void    (*libusbInterruptEventHandler_t)(libusb_context *);
   typedef struct libusb_transfer * (*libusbAllocTransfer_t)(int);
   typedef void    (*libusbFreeTransfer_t)(struct libusb_transfer *);
   typedef int     (*libusbSubmitTransfer_t)(struct libusb_transfer *);
@@ -125,6 +180,16 @@ private:
                                                unsigned char *, int,
                                                int *, unsigned int);
   typedef const char * (*libusbStrerror_t)(enum libusb_error);
+  typedef int     (*libusbHasCapability_t)(uint32_t);
+  typedef libusb_device * (*libusbRefDevice_t)(libusb_device *);
+  typedef void    (*libusbUnrefDevice_t)(libusb_device *);
+  typedef int     (*libusbHotplugRegisterCallback_t)(
+                              libusb_context *, int, int, int, int, int,
+                              libusb_hotplug_callback_fn, void *,
+                              libusb_hotplug_callback_handle *);
+  typedef void    (*libusbHotplugDeregisterCallback_t)(
+                              libusb_context *,
+                              libusb_hotplug_callback_handle);
 
   static const char *usbi_errors[];
   static const char *libusb_strerror(enum libusb_error);
@@ -156,6 +221,9 @@ public:
   libusbReleaseInterface_t          libusbReleaseInterface;
   libusbGetStringDescriptorAscii_t  libusbGetStringDescriptorAscii;
   libusbHandleEvents_t              libusbHandleEvents;
+  libusbHandleEventsTimeout_t       libusbHandleEventsTimeout;
+  // optional, libusb >= 1.0.21
+  libusbInterruptEventHandler_t     libusbInterruptEventHandler;
   libusbAllocTransfer_t             libusbAllocTransfer;
   libusbFreeTransfer_t              libusbFreeTransfer;
   libusbSubmitTransfer_t            libusbSubmitTransfer;
@@ -163,22 +231,94 @@ public:
   libusbControlTransfer_t           libusbControlTransfer;
   libusbInterruptTransfer_t         libusbInterruptTransfer;
   libusbStrerror_t                  libusbStrerror;
+  // optional, libusb >= 1.0.16, see hid_device_registry
+  libusbHasCapability_t             libusbHasCapability;
+  libusbRefDevice_t                 libusbRefDevice;
+  libusbUnrefDevice_t               libusbUnrefDevice;
+  libusbHotplugRegisterCallback_t   libusbHotplugRegisterCallback;
+  libusbHotplugDeregisterCallback_t libusbHotplugDeregisterCallback;
 };
 
+// hand written parts of the Python module, see pyhid/python_bindings.hpp
+namespace pyhid_python
+{
+  template <typename Parent> void bindReportBatch(Parent &);
+  template <typename Parent> void bindAsyncIO(Parent &);
+  template <typename Parent> void bindBlockingCalls(Parent &);
+}
+
+// Reports returned by one hid_libusb::readHIDBatch() call, packed back
+// to back into a single buffer.  Report i occupies
+// getData()[getOffsets()[i]] ... getData()[getOffsets()[i] + getLengths()[i] - 1]
+// and arrived at getTimestamps()[i] nanoseconds, see
+// hid_libusb::setTimestampClock().
+class GENPYBIND(visible, expose_as(reportbatch)) hid_report_batch
+{
+private:
+
+  std::vector<uint8_t> m_Data;
+  std::vector<size_t>  m_Offsets;
+  std::vector<size_t>  m_Lengths;
+  std::vector<uint64_t> m_Timestamps;
+
+  friend class hid_libusb;
+
+public:
+
+  size_t size() const GENPYBIND(expose_as(__len__));
+  std::vector<uint8_t> const& getData() const GENPYBIND(hidden);
+  std::vector<size_t> const& getOffsets() const GENPYBIND(getter_for(offsets));
+  std::vector<size_t> const& getLengths() const GENPYBIND(getter_for(lengths));
+  std::vector<uint64_t> const& getTimestamps() const
+    GENPYBIND(getter_for(timestamps));
+  std::vector<uint8_t> getReport(const size_t uiIndex) const GENPYBIND(hidden);
+
+  // data and getReport() as bytes
+  GENPYBIND_MANUAL({
+    pyhid_python::bindReportBatch(parent);
+  })
+};
+
+// Report callback, called on the dispatcher thread with every batch of
+// input reports taken from the main queue.  The batch may be moved from,
+// it belongs to the device and goes with it if the callback deletes it.
+typedef void (*hid_report_callback_t)(hid_report_batch &, void *);
+
 class GENPYBIND(visible, expose_as(pyhidaccess)) hid_libusb
 {
 private:
 
   typedef class hid_libusb self_type_t;
 
+  // one per dispatcher thread, it closes and deletes its own when it ends
+  typedef struct dispatcher
+  {
+    pthread_t thread;
+    int iEpoll;
+    int iWake;                  // eventfd in iEpoll, ends the thread
+  } dispatcher_t;
+
   static libusb_context  *m_pContext;
+  static pthread_mutex_t  m_EventLoopMutex;
+  static pthread_t        m_EventThread;
+  static unsigned int     m_uiEventLoopUsers;
+  static std::atomic<bool> m_bStopEventLoop;
+  static pthread_mutex_t  m_DispatchMutex;
+  static pthread_cond_t   m_DispatchCondition;
+  static thread_local hid_libusb *m_pDispatching;
+  static dispatcher_t    *m_pDispatcher;
+  // devices with a report callback, the dispatcher ends with the last
+  static unsigned int     m_uiReportCallbacks;
+  static std::set<hid_libusb *> m_Dispatched;
   libusb_device_handle   *m_pDeviceHandle;
-  input_report_t         *m_pInputReports;
-  bool                    m_bShutdownThread;
+  hid_report_queue        m_InputReports;
+  std::atomic<bool>       m_bShutdownThread;
+  std::atomic<int>        m_iActiveTransfers;
+  std::atomic<int>        m_iActiveWrites;
   pthread_barrier_t       m_Barrier;
-  pthread_cond_t          m_Condition;
-  pthread_mutex_t         m_Mutex;
   pthread_t               m_Thread;
+  // startTransfers() of the read thread, valid after the barrier
+  int                     m_iStartResult;
   size_t                  m_uiMaxPacketSize;
   int32_t                 m_iInputEndpoint;
   int32_t                 m_iOutputEndpoint;
@@ -192,34 +332,223 @@ private:
   char                    m_szDevAddr[4];
   hid_device_info_t      *m_pDevices;
   struct udev            *m_pUdev;
-  struct libusb_transfer *m_pTransfer;
+  struct libusb_transfer **m_ppTransfers;
+  uint8_t                *m_puiTransferBuffers;
+  size_t                  m_uiTransferDepth;
+  struct libusb_transfer **m_ppParkedTransfers;
+  std::atomic<int>        m_iParkedTransfers;
+  std::atomic<int>        m_iResumingReaders;
+  pthread_mutex_t         m_TransferMutex;
+  pthread_cond_t          m_TransferCondition;
+  size_t                  m_uiQueueCapacity;
+  hid_overflow_policy     m_eOverflowPolicy;
+  std::atomic<int>        m_iTimestampClock;
+  bool                    m_bDedicatedThread;
+  bool                    m_bUseDedicatedThread;
+  hid_write_queue         m_WriteQueue;
+  write_request_t        *m_pNextWrite;
+  output_transfer_t      *m_pOutputTransfers;
+  std::atomic<output_transfer_t *> m_pIdleWrites;
+  size_t                  m_uiOutputDepth;
+  std::atomic<bool>       m_bDrainingWrites;
+  std::atomic<bool>       m_bWritesPending;
+  hid_transaction_t      *m_pTransactions;
+  size_t                  m_uiTransactionWindow;
+  std::atomic<int>        m_iPendingTransactions;
+  uint64_t                m_uiTransactionSequence;
+  pthread_mutex_t         m_TransactionMutex;
+  pthread_cond_t          m_TransactionCondition;
+  hid_report_queue       *m_apReportQueues[256];
+  bool                    m_abReportQueues[256];
+  std::atomic<hid_input_filter_t *> m_pInputFilter;
+  hid_input_filter_t     *m_pRetiredFilters;
+  // odd while processInputReport() uses the filter set
+  std::atomic<uint64_t>   m_uiFilterEpoch;
+  std::atomic<uint64_t>   m_uiFilteredReports;
+  pthread_mutex_t         m_FilterMutex;
+  hid_report_callback_t   m_pReportCallback;
+  void                   *m_pReportCallbackData;
+  size_t                  m_uiCallbackBatch;
+  // filled by dispatchReports(), its buffers are reused unless the
+  // callback moves them away
+  hid_report_batch        m_DispatchBatch;
+  // callbacks in flight, guarded by m_DispatchMutex
+  unsigned int            m_uiDispatchRefs;
+  hid_capture            *m_pCapture;
+  // id of this device in m_pCapture, negative if it is not recorded
+  int                     m_iCaptureDevice;
+  hid_transport          *m_pTransport;
 
   static char *getUSBString(libusb_device_handle *, const uint8_t);
   static void readCallback(struct libusb_transfer *);
+  static void writeCallback(struct libusb_transfer *);
   static void *readThread(void *);
-  static void cleanupMutex(void *);
+  static void *eventThread(void *);
+  static int acquireEventLoop();
+  static void releaseEventLoop();
+  static void *dispatchThread(void *);
+  static bool stopDispatcher(pthread_t *);
+  int startDispatch();
+  void stopDispatch();
+  void waitDispatch();
+  void restartDispatch();
+  void storeReportCallback(hid_report_callback_t, void *, const size_t);
+  void dispatchReports(hid_report_callback_t, void *, const size_t);
+  int readBatch(hid_report_batch &, size_t, int);
+  uint64_t getTimestamp() const;
+  static uint64_t getCaptureTimestamp();
+  void processInputReport(const uint8_t *, size_t);
+  int startTransfers();
+  void waitTransfers();
+  void submitTransfer(struct libusb_transfer *);
+  void resumeTransfers();
+  void retireTransfer();
+  void notifyRetired();
+  void cancelTransfers();
+  void freeTransfers();
+  int allocWrites();
+  void freeWrites();
+  void drainWrites();
+  void submitWrite(output_transfer_t *, write_request_t *);
+  void completeWrite(output_transfer_t *, const int);
+  bool matchTransaction(const uint8_t *, size_t, uint64_t);
+  bool takeTransaction(const int, hid_transaction_callback_t *, void **);
+  void failTransactions(const int);
+  void allocReportQueues();
+  void freeReportQueues();
+  void shutdownQueues();
+  void publishFilter(hid_input_filter_t *);
+  void reclaimFilters();
+  void retireFilters();
+  void addCaptureDevice(const uint16_t, const uint16_t, const uint16_t,
+                        const uint16_t, const int32_t, const char *);
+  static void transactionWritten(int, void *);
+  static void transactionDone(int, const uint8_t *, size_t, uint64_t, void *);
+  static int initContext();
   static void freeHID();
   bool findUdevPath();
-  int returnData(uint8_t *, size_t);
+  int openRegisteredHID(const uint16_t, const uint16_t, std::string const&);
 
 public:
 
   hid_libusb();
   virtual ~hid_libusb();
-  virtual int enumerateHID(const uint16_t, const uint16_t);
+  // The blocking calls are bound by hand to release the GIL while they
+  // wait, see pyhid_python::bindBlockingCalls().
+  virtual int enumerateHID(const uint16_t, const uint16_t) GENPYBIND(hidden);
   virtual void freeHIDEnumeration();
-  int writeHID(std::vector<uint8_t> const&);
+  int writeHID(std::vector<uint8_t> const&) GENPYBIND(hidden);
   virtual int writeHID(const uint8_t *, size_t, const bool bFeature = false) GENPYBIND(hidden);
-  std::vector<uint8_t> readHID(size_t size, int timeout = -1);
+  virtual int writeHIDAsync(const uint8_t *puiData, size_t uiLength,
+                            hid_write_callback_t pCallback,
+                            void *pUserData = 0) GENPYBIND(hidden);
+  std::future<int> writeHIDAsync(std::vector<uint8_t> const&) GENPYBIND(hidden);
+  static int writeHIDGroup(hid_libusb *const *ppDevices, const size_t uiDevices,
+                           const uint8_t *const *ppuiData,
+                           const size_t *puiLengths,
+                           int *piResults) GENPYBIND(hidden);
+  static std::vector<int> writeHIDGroup(std::vector<hid_libusb *> const& devices,
+                                        std::vector<uint8_t> const& report)
+    GENPYBIND(hidden);
+  static std::vector<int> writeHIDGroup(std::vector<hid_libusb *> const& devices,
+                                        std::vector<std::vector<uint8_t> > const& reports)
+    GENPYBIND(hidden);
+  std::vector<uint8_t> readHID(size_t size, int timeout = -1) GENPYBIND(hidden);
   virtual int readHID(uint8_t *puiData, size_t uiLength,
-                      int iMilliseconds = -1) GENPYBIND(hidden);
+                      int iMilliseconds = -1,
+                      uint64_t *puiTimestamp = 0) GENPYBIND(hidden);
+  virtual int readHID(const uint8_t uiReportID, uint8_t *puiData,
+                      size_t uiLength, int iMilliseconds = -1,
+                      uint64_t *puiTimestamp = 0) GENPYBIND(hidden);
+  std::pair<std::vector<uint8_t>, uint64_t> readHIDTimestamped(size_t size,
+                                                               int timeout = -1)
+    GENPYBIND(hidden);
+  int readHIDInto(std::vector<uint8_t> &buffer, int timeout = -1)
+    GENPYBIND(hidden);
+  hid_report_batch readHIDBatch(size_t max_reports, int timeout = -1)
+    GENPYBIND(hidden);
+  virtual int readHIDBatch(uint8_t *puiData, size_t uiLength,
+                           size_t *puiOffsets, size_t *puiLengths,
+                           size_t uiMaxReports, int iMilliseconds = -1,
+                           uint64_t *puiTimestamps = 0) GENPYBIND(hidden);
+  virtual int submitTransaction(const uint8_t *puiRequest,
+                                size_t uiRequestLength,
+                                hid_report_matcher const& matcher,
+                                hid_transaction_callback_t pCallback,
+                                void *pUserData = 0,
+                                int iMilliseconds = -1) GENPYBIND(hidden);
+  virtual int cancelTransaction(const int iId) GENPYBIND(hidden);
+  virtual int transactHID(const uint8_t *puiRequest, size_t uiRequestLength,
+                          hid_report_matcher const& matcher,
+                          uint8_t *puiReply, size_t uiReplyLength,
+                          int iMilliseconds = -1,
+                          uint64_t *puiTimestamp = 0) GENPYBIND(hidden);
+  std::vector<uint8_t> transactHID(std::vector<uint8_t> const& request,
+                                   hid_report_matcher const& matcher,
+                                   size_t size, int timeout = -1)
+    GENPYBIND(hidden);
   virtual int readFeature(uint8_t *puiData, size_t uiLength,
                           int iMilliseconds = 0) GENPYBIND(hidden);
-  virtual int openHID(const uint16_t vid, const uint16_t pid, std::string const& serial = "");
-  virtual void closeHID();
+  virtual int openHID(const uint16_t vid, const uint16_t pid, std::string const& serial = "") GENPYBIND(hidden);
+  virtual void closeHID() GENPYBIND(hidden);
   virtual int openHIDDevice(const hid_device_info_t *) GENPYBIND(hidden);
-  virtual int waitDeviceReAdd(const uint16_t uiTimeout = 0);
+  virtual int waitDeviceReAdd(const uint16_t uiTimeout = 0) GENPYBIND(hidden);
+  // Opens a capture as a read only device.  Its input reports of device
+  // iDevice, or of all devices, go through the same path as reports of a
+  // real device.  The device is gone once the capture is drained.
+  int openReplay(std::string const& path,
+                 const hid_replay_speed eSpeed = HID_REPLAY_REALTIME,
+                 const double dScale = 1.0, const int iDevice = -1)
+    GENPYBIND(hidden);
+  // Opens a mock device, see hid_mock_transport.
+  int openMock(const double dRate, const size_t uiReportSize,
+               const uint32_t uiJitterUs = 0,
+               const uint64_t uiReports = HID_MOCK_UNLIMITED,
+               const bool bEcho = true) GENPYBIND(hidden);
+  // Opens a device on top of pTransport, which is owned by this device
+  // from now on, also on failure.  It is read by a thread of its own.
+  int openTransport(hid_emulated_transport *pTransport) GENPYBIND(hidden);
+  int setTransferDepth(const size_t uiDepth);
+  size_t getTransferDepth() const;
+  int setQueueCapacity(const size_t uiCapacity);
+  size_t getQueueCapacity() const;
+  int setOverflowPolicy(const hid_overflow_policy ePolicy);
+  hid_overflow_policy getOverflowPolicy() const;
+  uint64_t getDroppedReports() const;
+  // CLOCK_MONOTONIC or CLOCK_MONOTONIC_RAW for the queued reports, a
+  // capture is always stamped with CLOCK_MONOTONIC
+  int setTimestampClock(const int iClock);
+  int getTimestampClock() const;
+  int getInputFD();
+  int getInputFD(const uint8_t uiReportID);
+  int addInputFilter(hid_report_matcher const& matcher);
+  void clearInputFilters();
+  void setInputPredicate(hid_input_predicate_t pPredicate,
+                         void *pUserData = 0) GENPYBIND(hidden);
+  uint64_t getFilteredReports() const;
+  int setReportCallback(hid_report_callback_t pCallback, void *pUserData = 0,
+                        const size_t uiMaxReports = HID_LIBUSB_DEFAULT_CALLBACK_BATCH)
+    GENPYBIND(hidden);
+  // Gives reports starting with uiReportID a queue of their own.  Not
+  // with HID_OVERFLOW_BLOCK, either setting refuses the other one.
+  int setReportQueue(const uint8_t uiReportID, const bool bEnable);
+  bool getReportQueue(const uint8_t uiReportID) const;
+  // Records all reports of the device into capture, which has to outlive
+  // the device or be detached with setCapture(nullptr).
+  int setCapture(hid_capture *pCapture) GENPYBIND(keep_alive(this, pCapture));
+  int setDedicatedEventThread(const bool bDedicated);
+  bool getDedicatedEventThread() const;
+  int setOutputDepth(const size_t uiDepth);
+  size_t getOutputDepth() const;
+  size_t getQueuedWrites() const;
+  int setTransactionWindow(const size_t uiWindow);
+  size_t getTransactionWindow() const;
   static void getErrorString(const int, std::string &) GENPYBIND(hidden);
+
+  GENPYBIND_MANUAL({
+    pyhid_python::bindBlockingCalls(parent);
+    pyhid_python::bindAsyncIO(parent);
+  })
 };
 
 #endif
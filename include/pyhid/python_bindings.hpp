@@ -0,0 +1,666 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2026 TU-Dresden  All rights reserved.
+//
+// Unless otherwise stated, the software on this site is distributed
+// in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+// without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. THERE IS NO WARRANTY FOR THE SOFTWARE,
+// TO THE EXTENT PERMITTED BY APPLICABLE LAW. EXCEPT WHEN OTHERWISE
+// STATED IN WRITING THE COPYRIGHT HOLDERS PROVIDE THE SOFTWARE
+// "AS IS" WITHOUT WARRANTY OF ANY KIND, EITHER EXPRESSED OR IMPLIED,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE ENTIRE
+// RISK AS TO THE QUALITY AND PERFORMANCE OF THE SOFTWARE IS WITH YOU.
+// SHOULD THE SOFTWARE PROVE DEFECTIVE, YOU ASSUME THE COST OF ALL
+// NECESSARY SERVICING, REPAIR OR CORRECTION. IN NO EVENT UNLESS
+// REQUIRED BY APPLICABLE LAW OR AGREED TO IN WRITING WILL ANY
+// COPYRIGHT HOLDER, BE LIABLE TO YOU FOR DAMAGES, INCLUDING ANY
+// GENERAL, SPECIAL, INCIDENTAL OR CONSEQUENTIAL DAMAGES ARISING OUT
+// OF THE USE OR INABILITY TO USE THE SOFTWARE (INCLUDING BUT NOT
+// LIMITED TO LOSS OF DATA OR DATA BEING RENDERED INACCURATE OR LOSSES
+// SUSTAINED BY YOU OR THIRD PARTIES OR A FAILURE OF THE SOFTWARE TO
+// OPERATE WITH ANY OTHER PROGRAMS), EVEN IF SUCH HOLDER HAS BEEN
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+//
+//-----------------------------------------------------------------
+
+// Company           :   TU-Dresden
+//
+// Filename          :   python_bindings.hpp
+// Project Name      :   PyHID
+// Description       :   pybind11 glue of the genpybind module
+//-----------------------------------------------------------------
+#ifndef __PYHID_PYTHON_BINDINGS_HPP__
+#define __PYHID_PYTHON_BINDINGS_HPP__
+
+// Only included by the generated module, everything in here needs the
+// interpreter.  Hooked into the classes via GENPYBIND_MANUAL.
+
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+#include "pyhid/hid_libusb.hpp"
+
+namespace pyhid_python
+{
+
+namespace py = pybind11;
+
+inline py::object runtimeError(int const error)
+{
+	std::string message;
+	hid_libusb::getErrorString(error, message);
+	return py::module::import("builtins").attr("RuntimeError")(message);
+}
+
+inline void throwError(int const error)
+{
+	std::string message;
+	hid_libusb::getErrorString(error, message);
+	throw std::runtime_error(message);
+}
+
+// Copies the next report straight from the queue into a new bytes object,
+// the only copy on its way to Python.  The GIL is released while waiting,
+// the object is not visible to anyone else until it is returned.  Returns
+// the readHID() result, report is only set if it is positive.  A
+// report_id >= 0 reads from the queue of that report ID.
+inline int readBytes(
+    hid_libusb& device,
+    size_t const size,
+    int const timeout,
+    py::object& report,
+    uint64_t* timestamp = 0,
+    int const report_id = -1)
+{
+	if (report_id > 0xff)
+		return HID_LIBUSB_INVALID_ARGS;
+
+	PyObject* bytes = PyBytes_FromStringAndSize(NULL, size);
+	if (!bytes)
+		throw py::error_already_set();
+	uint8_t* data = reinterpret_cast<uint8_t*>(PyBytes_AS_STRING(bytes));
+
+	int ret;
+	{
+		std::unique_ptr<py::gil_scoped_release> release;
+		if (timeout)
+			release.reset(new py::gil_scoped_release);
+		if (report_id < 0)
+			ret = device.readHID(data, size, timeout, timestamp);
+		else
+			ret = device.readHID(static_cast<uint8_t>(report_id), data, size, timeout, timestamp);
+	}
+
+	if (ret <= 0) {
+		Py_DECREF(bytes);
+		return ret;
+	}
+	if (static_cast<size_t>(ret) < size && _PyBytes_Resize(&bytes, ret) < 0)
+		throw py::error_already_set();
+	report = py::reinterpret_steal<py::object>(bytes);
+	return ret;
+}
+
+inline py::bytes readHID(
+    hid_libusb& self, size_t const size, int const timeout, int const report_id)
+{
+	py::object report = py::bytes();
+	int ret = readBytes(self, size, timeout, report, 0, report_id);
+	if (ret < 0)
+		throwError(ret);
+	return py::reinterpret_borrow<py::bytes>(report);
+}
+
+inline py::tuple readHIDTimestamped(hid_libusb& self, size_t const size, int const timeout)
+{
+	py::object report = py::bytes();
+	uint64_t timestamp = 0;
+	int ret = readBytes(self, size, timeout, report, &timestamp);
+	if (ret < 0)
+		throwError(ret);
+	return py::make_tuple(report, timestamp);
+}
+
+// Contiguous view into a buffer protocol object, the memory stays pinned
+// until the view is destroyed, so it can be used without the GIL.
+class buffer_view
+{
+public:
+	buffer_view(py::handle object, int const flags)
+	{
+		if (PyObject_GetBuffer(object.ptr(), &m_view, flags | PyBUF_ANY_CONTIGUOUS) < 0)
+			throw py::error_already_set();
+	}
+
+	~buffer_view() { PyBuffer_Release(&m_view); }
+
+	uint8_t* data() const { return static_cast<uint8_t*>(m_view.buf); }
+	size_t size() const { return m_view.len; }
+
+private:
+	buffer_view(buffer_view const&);
+	buffer_view& operator=(buffer_view const&);
+
+	Py_buffer m_view;
+};
+
+inline int readHIDInto(hid_libusb& self, py::buffer buffer, int const timeout)
+{
+	buffer_view view(buffer, PyBUF_WRITABLE);
+	int ret;
+	{
+		py::gil_scoped_release release;
+		ret = self.readHID(view.data(), view.size(), timeout);
+	}
+	if (ret < 0)
+		throwError(ret);
+	return ret;
+}
+
+// writes straight from the caller's memory, no intermediate vector
+inline int writeHID(hid_libusb& self, py::buffer data)
+{
+	buffer_view view(data, PyBUF_SIMPLE);
+	int ret;
+	{
+		py::gil_scoped_release release;
+		ret = self.writeHID(view.data(), view.size());
+	}
+	if (ret < 0)
+		throwError(ret);
+	return ret;
+}
+
+inline py::bytes transactHID(
+    hid_libusb& self,
+    py::buffer request,
+    hid_report_matcher const& matcher,
+    size_t const size,
+    int const timeout)
+{
+	buffer_view view(request, PyBUF_SIMPLE);
+	PyObject* bytes = PyBytes_FromStringAndSize(NULL, size);
+	if (!bytes)
+		throw py::error_already_set();
+	py::object reply = py::reinterpret_steal<py::object>(bytes);
+	uint8_t* data = reinterpret_cast<uint8_t*>(PyBytes_AS_STRING(bytes));
+
+	int ret;
+	{
+		py::gil_scoped_release release;
+		ret = self.transactHID(view.data(), view.size(), matcher, data, size, timeout);
+	}
+	if (ret < 0)
+		throwError(ret);
+	if (static_cast<size_t>(ret) < size) {
+		bytes = reply.release().ptr();
+		if (_PyBytes_Resize(&bytes, ret) < 0)
+			throw py::error_already_set();
+		reply = py::reinterpret_steal<py::object>(bytes);
+	}
+	return py::reinterpret_borrow<py::bytes>(reply);
+}
+
+struct async_write;
+
+// Futures of one device pending on a running asyncio loop.  Reads are
+// served whenever the input report eventfd becomes readable, completed
+// writes are handed over from the libusb event thread through a second
+// eventfd.  Python objects are only ever touched on the loop thread.
+struct async_device
+{
+	py::object self;
+	hid_libusb* device;
+	py::object loop;
+	int input_fd;
+	int write_fd;
+	std::deque<std::pair<py::object, size_t> > reads;
+	size_t pending_writes;
+	std::mutex completed_mutex;
+	std::vector<async_write*> completed;
+
+	~async_device()
+	{
+		if (input_fd >= 0)
+			close(input_fd);
+		if (write_fd >= 0)
+			close(write_fd);
+	}
+};
+
+struct async_write
+{
+	async_device* state;
+	PyObject* future;
+	int result;
+};
+
+typedef std::map<hid_libusb*, std::shared_ptr<async_device> > async_devices_t;
+
+inline async_devices_t& asyncDevices()
+{
+	// never destroyed, it may hold Python objects at interpreter shutdown
+	static async_devices_t* devices = new async_devices_t;
+	return *devices;
+}
+
+inline std::shared_ptr<async_device> asyncDevice(py::object const& self)
+{
+	hid_libusb* device = self.cast<hid_libusb*>();
+	py::object loop = py::module::import("asyncio").attr("get_running_loop")();
+
+	async_devices_t& devices = asyncDevices();
+	async_devices_t::iterator it = devices.find(device);
+	if (it != devices.end()) {
+		if (!it->second->loop.is(loop))
+			throw std::runtime_error("hid: Device is awaited on another event loop.");
+		return it->second;
+	}
+
+	std::shared_ptr<async_device> state = std::make_shared<async_device>();
+	state->self = self;
+	state->device = device;
+	state->loop = loop;
+	state->input_fd = -1;
+	state->write_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	state->pending_writes = 0;
+	if (state->write_fd < 0)
+		throw std::runtime_error("hid: Failed to create an eventfd.");
+	devices[device] = state;
+	return state;
+}
+
+inline void releaseAsyncDevice(std::shared_ptr<async_device> const& state)
+{
+	if (state->reads.empty() && !state->pending_writes)
+		asyncDevices().erase(state->device);
+}
+
+inline void stopReads(std::shared_ptr<async_device> const& state)
+{
+	state->loop.attr("remove_reader")(state->input_fd);
+	close(state->input_fd);
+	state->input_fd = -1;
+	releaseAsyncDevice(state);
+}
+
+inline void serveReads(std::shared_ptr<async_device> const& state)
+{
+	while (!state->reads.empty()) {
+		py::object future = state->reads.front().first;
+		if (future.attr("done")().cast<bool>()) {
+			// cancelled by its awaiter
+			state->reads.pop_front();
+			continue;
+		}
+
+		// a zero length report cannot be told apart from an empty queue
+		py::object report;
+		int ret = readBytes(*state->device, state->reads.front().second, 0, report);
+		if (ret == 0)
+			break;
+		state->reads.pop_front();
+
+		if (ret < 0) {
+			// closed or lost device, nothing will arrive anymore
+			future.attr("set_exception")(runtimeError(ret));
+			while (!state->reads.empty()) {
+				future = state->reads.front().first;
+				state->reads.pop_front();
+				if (!future.attr("done")().cast<bool>())
+					future.attr("set_exception")(runtimeError(ret));
+			}
+			break;
+		}
+		future.attr("set_result")(report);
+	}
+
+	if (state->reads.empty())
+		stopReads(state);
+}
+
+inline py::object readHIDAsync(py::object self, size_t const size)
+{
+	std::shared_ptr<async_device> state = asyncDevice(self);
+	py::object future = state->loop.attr("create_future")();
+
+	if (state->reads.empty()) {
+		py::object report;
+		int ret = readBytes(*state->device, size, 0, report);
+		if (ret == 0)
+			ret = state->device->getInputFD();
+		else if (ret > 0) {
+			future.attr("set_result")(report);
+			releaseAsyncDevice(state);
+			return future;
+		}
+		// Watch a duplicate of the queue's eventfd: closeHID() signals and
+		// closes the original, the duplicate still wakes up the loop to
+		// fail the pending reads.
+		if (ret >= 0)
+			state->input_fd = fcntl(ret, F_DUPFD_CLOEXEC, 0);
+		if (ret < 0 || state->input_fd < 0) {
+			future.attr("set_exception")(runtimeError(ret < 0 ? ret : HID_LIBUSB_READ_ERROR));
+			releaseAsyncDevice(state);
+			return future;
+		}
+		state->loop.attr("add_reader")(
+		    state->input_fd, py::cpp_function([state]() { serveReads(state); }));
+	}
+	state->reads.emplace_back(future, size);
+	return future;
+}
+
+// runs on the libusb event thread, without the GIL
+inline void writeCompleted(int const result, void* user)
+{
+	async_write* request = static_cast<async_write*>(user);
+	async_device* state = request->state;
+
+	request->result = result;
+	{
+		std::lock_guard<std::mutex> lock(state->completed_mutex);
+		state->completed.push_back(request);
+	}
+	uint64_t const one = 1;
+	if (write(state->write_fd, &one, sizeof(one)) < 0) {
+		// the counter cannot overflow with a single wakeup per write
+	}
+}
+
+inline void serveWrites(std::shared_ptr<async_device> const& state)
+{
+	// reset before taking the list, a completion racing with us
+	// signals again
+	uint64_t count;
+	if (read(state->write_fd, &count, sizeof(count)) < 0) {
+		// EAGAIN, nothing new
+	}
+
+	std::vector<async_write*> completed;
+	{
+		std::lock_guard<std::mutex> lock(state->completed_mutex);
+		completed.swap(state->completed);
+	}
+
+	for (size_t i = 0; i < completed.size(); i++) {
+		py::object future = py::reinterpret_steal<py::object>(completed[i]->future);
+		int const result = completed[i]->result;
+		delete completed[i];
+		state->pending_writes--;
+
+		if (future.attr("done")().cast<bool>())
+			continue;
+		if (result < 0)
+			future.attr("set_exception")(runtimeError(result));
+		else
+			future.attr("set_result")(result);
+	}
+
+	if (!state->pending_writes) {
+		state->loop.attr("remove_reader")(state->write_fd);
+		releaseAsyncDevice(state);
+	}
+}
+
+// the report is copied before writeHIDAsync() returns
+inline py::object writeHIDAsync(py::object self, uint8_t const* data, size_t const size)
+{
+	std::shared_ptr<async_device> state = asyncDevice(self);
+	py::object future = state->loop.attr("create_future")();
+
+	if (!state->pending_writes)
+		state->loop.attr("add_reader")(
+		    state->write_fd, py::cpp_function([state]() { serveWrites(state); }));
+	state->pending_writes++;
+
+	async_write* request = new async_write;
+	request->state = state.get();
+	request->future = future.inc_ref().ptr();
+	request->result = 0;
+
+	int ret = state->device->writeHIDAsync(data, size, &writeCompleted, request);
+	if (ret < 0) {
+		// not submitted, fail it through the regular completion path
+		writeCompleted(ret, request);
+	}
+	return future;
+}
+
+inline py::object writeHIDAsync(py::object self, py::buffer data)
+{
+	buffer_view view(data, PyBUF_SIMPLE);
+	return writeHIDAsync(self, view.data(), view.size());
+}
+
+inline py::object writeHIDAsync(py::object self, std::vector<uint8_t> const& data)
+{
+	return writeHIDAsync(self, data.data(), data.size());
+}
+
+// Python report callback of one device.  Holds the device as well, it
+// cannot be destroyed (and wait for the GIL in closeHID()) while the
+// dispatcher thread may be calling into Python.  closeHID() ends the
+// stream and lets go of the device.
+struct report_stream
+{
+	py::object self;
+	py::object callback;
+};
+
+typedef std::map<hid_libusb*, std::unique_ptr<report_stream> > report_streams_t;
+
+inline report_streams_t& reportStreams()
+{
+	// never destroyed, it may hold Python objects at interpreter shutdown
+	static report_streams_t* streams = new report_streams_t;
+	return *streams;
+}
+
+// runs on the dispatcher thread, the GIL is taken once per batch
+inline void streamReports(hid_report_batch& batch, void* user)
+{
+	py::gil_scoped_acquire acquire;
+	report_stream* stream = static_cast<report_stream*>(user);
+	try {
+		stream->callback(py::cast(std::move(batch)));
+	} catch (py::error_already_set& error) {
+		// nobody to raise to, report it like an exception in a __del__
+		error.restore();
+		PyErr_WriteUnraisable(stream->callback.ptr());
+	} catch (std::exception& error) {
+		// the batch is dropped, the next one is dispatched as usual
+		PyErr_SetString(PyExc_RuntimeError, error.what());
+		PyErr_WriteUnraisable(stream->callback.ptr());
+	} catch (...) {
+		PyErr_SetString(PyExc_RuntimeError, "report callback failed");
+		PyErr_WriteUnraisable(stream->callback.ptr());
+	}
+}
+
+inline void setReportCallback(py::object self, py::object callback, size_t const max_reports)
+{
+	hid_libusb* device = self.cast<hid_libusb*>();
+	std::unique_ptr<report_stream> stream;
+	if (!callback.is_none()) {
+		stream.reset(new report_stream);
+		stream->self = self;
+		stream->callback = callback;
+	}
+
+	int ret;
+	{
+		py::gil_scoped_release release;
+		ret = device->setReportCallback(stream ? &streamReports : 0, stream.get(), max_reports);
+	}
+	if (ret < 0)
+		throwError(ret);
+
+	// the dispatcher is done with the previous callback
+	report_streams_t& streams = reportStreams();
+	if (stream)
+		streams[device].swap(stream);
+	else
+		streams.erase(device);
+}
+
+inline void closeHID(py::object self)
+{
+	hid_libusb* device = self.cast<hid_libusb*>();
+	{
+		py::gil_scoped_release release;
+		device->closeHID();
+		device->setReportCallback(0);
+	}
+	// dropping the stream may drop the last reference to the device
+	std::unique_ptr<report_stream> stream;
+	report_streams_t& streams = reportStreams();
+	report_streams_t::iterator it = streams.find(device);
+	if (it != streams.end()) {
+		stream.swap(it->second);
+		streams.erase(it);
+	}
+}
+
+// Everything that may wait on the device or on the libusb event thread
+// runs without the GIL, other Python threads keep going meanwhile.
+template <typename Parent>
+void bindBlockingCalls(Parent& parent)
+{
+	typedef py::call_guard<py::gil_scoped_release> release_gil;
+
+	parent.def(
+	    "enumerateHID",
+	    static_cast<int (hid_libusb::*)(uint16_t, uint16_t)>(&hid_libusb::enumerateHID),
+	    release_gil());
+	parent.def(
+	    "openHID", &hid_libusb::openHID, py::arg("vid"), py::arg("pid"),
+	    py::arg("serial") = std::string(), release_gil());
+	// drops the report callback as well, see report_stream
+	parent.def("closeHID", &closeHID);
+	// their read thread is started and joined here as well
+	parent.def(
+	    "openReplay", &hid_libusb::openReplay, py::arg("path"),
+	    py::arg("speed") = HID_REPLAY_REALTIME, py::arg("scale") = 1.0,
+	    py::arg("device") = -1, release_gil());
+	parent.def(
+	    "openMock", &hid_libusb::openMock, py::arg("rate"), py::arg("report_size"),
+	    py::arg("jitter_us") = 0, py::arg("reports") = HID_MOCK_UNLIMITED,
+	    py::arg("echo") = true, release_gil());
+	// bytes, bytearray, memoryview and numpy arrays are tried first,
+	// any other sequence of ints goes through the vector overload
+	parent.def("writeHID", &writeHID, py::arg("data"));
+	parent.def(
+	    "writeHID",
+	    static_cast<int (hid_libusb::*)(std::vector<uint8_t> const&)>(&hid_libusb::writeHID),
+	    py::arg("data"), release_gil());
+	// release the GIL themselves, the report is read into a bytes object
+	parent.def(
+	    "readHID", &readHID, py::arg("size"), py::arg("timeout") = -1,
+	    py::arg("report_id") = -1,
+	    "Reads from the queue of report_id if given, see setReportQueue().");
+	parent.def(
+	    "readHIDTimestamped", &readHIDTimestamped, py::arg("size"), py::arg("timeout") = -1);
+	parent.def(
+	    "readHIDInto", &readHIDInto, py::arg("buffer"), py::arg("timeout") = -1,
+	    "Copies the next report into a writable buffer and returns its length.");
+	parent.def(
+	    "readHIDBatch",
+	    static_cast<hid_report_batch (hid_libusb::*)(size_t, int)>(&hid_libusb::readHIDBatch),
+	    py::arg("max_reports"), py::arg("timeout") = -1, release_gil());
+	parent.def(
+	    "transactHID", &transactHID, py::arg("request"), py::arg("matcher"), py::arg("size"),
+	    py::arg("timeout") = -1,
+	    "Writes request and returns the first following report accepted by matcher.");
+	// per device results, bytes written or a negative error code
+	parent.def_static(
+	    "writeHIDGroup",
+	    static_cast<std::vector<int> (*)(
+	        std::vector<hid_libusb*> const&, std::vector<uint8_t> const&)>(
+	        &hid_libusb::writeHIDGroup),
+	    py::arg("devices"), py::arg("report"), release_gil());
+	parent.def_static(
+	    "writeHIDGroup",
+	    static_cast<std::vector<int> (*)(
+	        std::vector<hid_libusb*> const&, std::vector<std::vector<uint8_t> > const&)>(
+	        &hid_libusb::writeHIDGroup),
+	    py::arg("devices"), py::arg("reports"), release_gil());
+	parent.def(
+	    "waitDeviceReAdd", &hid_libusb::waitDeviceReAdd, py::arg("uiTimeout") = 0,
+	    release_gil());
+}
+
+// Starting and joining the writer thread and writing the index may take
+// a while, other Python threads keep going meanwhile.
+template <typename Parent>
+void bindCapture(Parent& parent)
+{
+	typedef py::call_guard<py::gil_scoped_release> release_gil;
+
+	parent.def(
+	    "open", &hid_capture::open, py::arg("path"),
+	    py::arg("buffer_size") = HID_CAPTURE_DEFAULT_BUFFER, release_gil());
+	parent.def("close", &hid_capture::close, release_gil());
+}
+
+template <typename Parent>
+void bindReportBatch(Parent& parent)
+{
+	parent.def_property_readonly("data", [](hid_report_batch const& self) {
+		std::vector<uint8_t> const& data = self.getData();
+		return py::bytes(reinterpret_cast<char const*>(data.data()), data.size());
+	});
+	parent.def(
+	    "getReport",
+	    [](hid_report_batch const& self, size_t const index) {
+		    if (index >= self.size())
+			    throw py::index_error("hid_report_batch::getReport: index out of range");
+		    size_t const offset = self.getOffsets()[index];
+		    return py::bytes(
+		        reinterpret_cast<char const*>(self.getData().data() + offset),
+		        self.getLengths()[index]);
+	    },
+	    py::arg("index"));
+}
+
+template <typename Parent>
+void bindAsyncIO(Parent& parent)
+{
+	parent.def(
+	    "readHIDAsync", &readHIDAsync, py::arg("size"),
+	    "Awaitable readHID() served by the running asyncio event loop.");
+	// buffers first, any other sequence of ints as in writeHID()
+	parent.def(
+	    "writeHIDAsync",
+	    static_cast<py::object (*)(py::object, py::buffer)>(&writeHIDAsync),
+	    py::arg("data"),
+	    "Awaitable writeHID() completed by the running asyncio event loop.");
+	parent.def(
+	    "writeHIDAsync",
+	    static_cast<py::object (*)(py::object, std::vector<uint8_t> const&)>(&writeHIDAsync),
+	    py::arg("data"));
+	parent.def(
+	    "setReportCallback", &setReportCallback, py::arg("callback"),
+	    py::arg("max_reports") = HID_LIBUSB_DEFAULT_CALLBACK_BATCH,
+	    "Calls callback(reportbatch) from a dispatcher thread as reports arrive,\n"
+	    "until it is set to None or the device is closed.");
+}
+
+} // namespace pyhid_python
+
+#endif
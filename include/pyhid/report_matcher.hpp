@@ -0,0 +1,80 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2026 TU-Dresden  All rights reserved.
+//
+// Unless otherwise stated, the software on this site is distributed
+// in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+// without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. THERE IS NO WARRANTY FOR THE SOFTWARE,
+// TO THE EXTENT PERMITTED BY APPLICABLE LAW. EXCEPT WHEN OTHERWISE
+// STATED IN WRITING THE COPYRIGHT HOLDERS PROVIDE THE SOFTWARE
+// "AS IS" WITHOUT WARRANTY OF ANY KIND, EITHER EXPRESSED OR IMPLIED,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE ENTIRE
+// RISK AS TO THE QUALITY AND PERFORMANCE OF THE SOFTWARE IS WITH YOU.
+// SHOULD THE SOFTWARE PROVE DEFECTIVE, YOU ASSUME THE COST OF ALL
+// NECESSARY SERVICING, REPAIR OR CORRECTION. IN NO EVENT UNLESS
+// REQUIRED BY APPLICABLE LAW OR AGREED TO IN WRITING WILL ANY
+// COPYRIGHT HOLDER, BE LIABLE TO YOU FOR DAMAGES, INCLUDING ANY
+// GENERAL, SPECIAL, INCIDENTAL OR CONSEQUENTIAL DAMAGES ARISING OUT
+// OF THE USE OR INABILITY TO USE THE SOFTWARE (INCLUDING BUT NOT
+// LIMITED TO LOSS OF DATA OR DATA BEING RENDERED INACCURATE OR LOSSES
+// SUSTAINED BY YOU OR THIRD PARTIES OR A FAILURE OF THE SOFTWARE TO
+// OPERATE WITH ANY OTHER PROGRAMS), EVEN IF SUCH HOLDER HAS BEEN
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+//
+//-----------------------------------------------------------------
+
+// Company           :   TU-Dresden
+//
+// Filename          :   report_matcher.hpp
+// Project Name      :   PyHID
+// Description       :   Input report content matcher
+//-----------------------------------------------------------------
+#ifndef __REPORT_MATCHER_HPP__
+#define __REPORT_MATCHER_HPP__
+
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+#include <genpybind.h>
+
+// Selects input reports by content.  A report matches if it is at least
+// as long as the mask and (report[i] & mask[i]) == pattern[i] for every
+// byte of the mask, so an empty matcher matches every report.
+// reportID() builds the common case of comparing the first byte only.
+class GENPYBIND(visible, expose_as(reportmatcher)) hid_report_matcher
+{
+private:
+
+  std::vector<uint8_t> m_Mask;
+  std::vector<uint8_t> m_Pattern;
+
+public:
+
+  hid_report_matcher();
+  hid_report_matcher(std::vector<uint8_t> const& mask,
+                     std::vector<uint8_t> const& pattern);
+
+  static hid_report_matcher reportID(const uint8_t uiReportID);
+
+  // called for every input report on the libusb event thread
+  bool matches(const uint8_t *puiData, const size_t uiLength) const
+    GENPYBIND(hidden)
+  {
+    const size_t uiMaskLength = this->m_Mask.size();
+    if ( uiLength < uiMaskLength )
+      return false;
+    for ( size_t i = 0; i < uiMaskLength; i++ )
+      if ( ( puiData[i] & this->m_Mask[i] ) != this->m_Pattern[i] )
+        return false;
+    return true;
+  }
+
+  bool matches(std::vector<uint8_t> const& report) const;
+  std::vector<uint8_t> const& getMask() const GENPYBIND(getter_for(mask));
+  std::vector<uint8_t> const& getPattern() const
+    GENPYBIND(getter_for(pattern));
+};
+
+#endif
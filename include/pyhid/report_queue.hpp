@@ -0,0 +1,157 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2026 TU-Dresden  All rights reserved.
+//
+// Unless otherwise stated, the software on this site is distributed
+// in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+// without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. THERE IS NO WARRANTY FOR THE SOFTWARE,
+// TO THE EXTENT PERMITTED BY APPLICABLE LAW. EXCEPT WHEN OTHERWISE
+// STATED IN WRITING THE COPYRIGHT HOLDERS PROVIDE THE SOFTWARE
+// "AS IS" WITHOUT WARRANTY OF ANY KIND, EITHER EXPRESSED OR IMPLIED,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE ENTIRE
+// RISK AS TO THE QUALITY AND PERFORMANCE OF THE SOFTWARE IS WITH YOU.
+// SHOULD THE SOFTWARE PROVE DEFECTIVE, YOU ASSUME THE COST OF ALL
+// NECESSARY SERVICING, REPAIR OR CORRECTION. IN NO EVENT UNLESS
+// REQUIRED BY APPLICABLE LAW OR AGREED TO IN WRITING WILL ANY
+// COPYRIGHT HOLDER, BE LIABLE TO YOU FOR DAMAGES, INCLUDING ANY
+// GENERAL, SPECIAL, INCIDENTAL OR CONSEQUENTIAL DAMAGES ARISING OUT
+// OF THE USE OR INABILITY TO USE THE SOFTWARE (INCLUDING BUT NOT
+// LIMITED TO LOSS OF DATA OR DATA BEING RENDERED INACCURATE OR LOSSES
+// SUSTAINED BY YOU OR THIRD PARTIES OR A FAILURE OF THE SOFTWARE TO
+// OPERATE WITH ANY OTHER PROGRAMS), EVEN IF SUCH HOLDER HAS BEEN
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+//
+//-----------------------------------------------------------------
+
+// Company           :   TU-Dresden
+//
+// Filename          :   report_queue.hpp
+// Project Name      :   PyHID
+// Description       :   Lock-free input report queue
+//-----------------------------------------------------------------
+#ifndef __REPORT_QUEUE_HPP__
+#define __REPORT_QUEUE_HPP__
+
+#include <stdint.h>
+#include <cstddef>
+#include <atomic>
+#include <pthread.h>
+#include <genpybind.h>
+
+#define HID_LIBUSB_DEFAULT_QUEUE_SIZE 32
+#define HID_LIBUSB_SLOT_ALIGNMENT     64
+
+typedef struct input_report
+{
+  uint8_t             *puiData;
+  size_t               uiLength;
+  uint64_t             uiTimestamp;
+} input_report_t;
+
+// What happens to an input report arriving while the queue is full.
+// HID_OVERFLOW_BLOCK is lossless: interrupt IN transfers are not
+// resubmitted until the reader made room, so the device buffers or NAKs.
+enum GENPYBIND(visible) hid_overflow_policy
+{
+  HID_OVERFLOW_DROP_OLDEST = 0,
+  HID_OVERFLOW_DROP_NEWEST = 1,
+  HID_OVERFLOW_BLOCK       = 2
+};
+
+typedef struct report_slot
+{
+  std::atomic<size_t>  uiSequence;
+  input_report_t       report;
+} report_slot_t;
+
+// Fixed capacity ring of input reports with a single producer (the
+// libusb event thread).  The producer never takes a lock; it only touches
+// m_Mutex to wake a reader that is blocked in read().  Readers serialise
+// on m_Mutex among themselves, so read() may be called from several
+// threads while push() stays lock-free.
+//
+// Every slot carries a sequence number telling whether it is free for
+// the producer or holds a published report.  Readers claim the head slot
+// with a compare-and-swap before copying it out, which allows the
+// producer to retire the oldest report itself under
+// HID_OVERFLOW_DROP_OLDEST.
+//
+// Report storage is one slab allocated by init(), with every slot
+// padded to a cache line multiple, so steady-state streaming never
+// touches the heap.
+//
+// eventFD() hands out an eventfd that is readable while reports are
+// queued (or the queue was shut down).  It is only created on request,
+// the producer writes it on the transition from empty to non-empty and
+// the reader clears it when it drained the queue.
+//
+// Readers are counted in m_iReaders, destroy() wakes them and waits
+// until the last one left before the mutex goes away.
+class hid_report_queue
+{
+private:
+
+  typedef class hid_report_queue self_type_t;
+
+  // head and tail are written by different threads, keep them on
+  // separate cache lines
+  std::atomic<size_t>             m_uiHead;
+  char                            m_cPadHead[64 - sizeof(size_t)];
+  std::atomic<size_t>             m_uiTail;
+  char                            m_cPadTail[64 - sizeof(size_t)];
+  std::atomic<long>               m_iCredits;
+  std::atomic<uint64_t>           m_uiDropped;
+  std::atomic<int>                m_iWaiters;
+  std::atomic<int>                m_iReaders;
+  std::atomic<bool>               m_bShutdown;
+  std::atomic<bool>               m_bDestroying;
+  std::atomic<int>                m_iEventFd;
+  report_slot_t                  *m_pSlots;
+  uint8_t                        *m_puiStorage;
+  size_t                          m_uiCapacity;
+  size_t                          m_uiSlots;
+  size_t                          m_uiSlotSize;
+  hid_overflow_policy             m_ePolicy;
+  pthread_cond_t                  m_Condition;
+  pthread_mutex_t                 m_Mutex;
+
+  void dropOldest(const size_t);
+  int copyReport(uint8_t *, size_t, uint64_t *);
+  int waitForReport(int);
+  void signalEvent();
+  void clearEvent();
+  bool enterReader();
+  static void cleanupMutex(void *);
+
+  hid_report_queue(const hid_report_queue &);
+  hid_report_queue &operator=(const hid_report_queue &);
+
+public:
+
+  hid_report_queue();
+  ~hid_report_queue();
+
+  int init(const size_t uiCapacity, const size_t uiMaxReportSize,
+           const hid_overflow_policy ePolicy = HID_OVERFLOW_DROP_OLDEST);
+  void destroy();
+
+  bool push(const uint8_t *, size_t, const uint64_t uiTimestamp = 0);
+  bool reserve();
+  void release();
+  int read(uint8_t *, size_t, int iMilliseconds = -1,
+           uint64_t *puiTimestamp = 0);
+  int readBatch(uint8_t *, size_t, size_t *, size_t *, size_t,
+                int iMilliseconds = -1, uint64_t *puiTimestamps = 0);
+  void shutdown();
+  int eventFD();
+
+  bool empty() const;
+  size_t size() const;
+  size_t capacity() const { return this->m_uiCapacity; }
+  size_t reportSize() const { return this->m_uiSlotSize; }
+  uint64_t dropped() const { return this->m_uiDropped.load(); }
+};
+
+#endif
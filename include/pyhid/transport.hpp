@@ -0,0 +1,297 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2026 TU-Dresden  All rights reserved.
+//
+// Unless otherwise stated, the software on this site is distributed
+// in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+// without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. THERE IS NO WARRANTY FOR THE SOFTWARE,
+// TO THE EXTENT PERMITTED BY APPLICABLE LAW. EXCEPT WHEN OTHERWISE
+// STATED IN WRITING THE COPYRIGHT HOLDERS PROVIDE THE SOFTWARE
+// "AS IS" WITHOUT WARRANTY OF ANY KIND, EITHER EXPRESSED OR IMPLIED,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE ENTIRE
+// RISK AS TO THE QUALITY AND PERFORMANCE OF THE SOFTWARE IS WITH YOU.
+// SHOULD THE SOFTWARE PROVE DEFECTIVE, YOU ASSUME THE COST OF ALL
+// NECESSARY SERVICING, REPAIR OR CORRECTION. IN NO EVENT UNLESS
+// REQUIRED BY APPLICABLE LAW OR AGREED TO IN WRITING WILL ANY
+// COPYRIGHT HOLDER, BE LIABLE TO YOU FOR DAMAGES, INCLUDING ANY
+// GENERAL, SPECIAL, INCIDENTAL OR CONSEQUENTIAL DAMAGES ARISING OUT
+// OF THE USE OR INABILITY TO USE THE SOFTWARE (INCLUDING BUT NOT
+// LIMITED TO LOSS OF DATA OR DATA BEING RENDERED INACCURATE OR LOSSES
+// SUSTAINED BY YOU OR THIRD PARTIES OR A FAILURE OF THE SOFTWARE TO
+// OPERATE WITH ANY OTHER PROGRAMS), EVEN IF SUCH HOLDER HAS BEEN
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+//
+//-----------------------------------------------------------------
+
+// Company           :   TU-Dresden
+//
+// Filename          :   transport.hpp
+// Project Name      :   PyHID
+// Description       :   Transfer primitives of libusb and emulated devices
+//-----------------------------------------------------------------
+#ifndef __TRANSPORT_HPP__
+#define __TRANSPORT_HPP__
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <sys/time.h>
+#include <time.h>
+#include <libusb.h>
+#include <genpybind.h>
+
+#include "pyhid/capture.hpp"
+
+#define HID_MOCK_UNLIMITED            0xffffffffffffffffULL
+#define HID_LIBUSB_REPLAY_REPORT_SIZE 1024
+// output reports an echoing mock holds until they are read back
+#define HID_MOCK_ECHO_DEPTH           32
+
+// Pace of a replayed capture, see hid_libusb::openReplay().
+enum GENPYBIND(visible) hid_replay_speed
+{
+  HID_REPLAY_FAST     = 0,
+  HID_REPLAY_REALTIME = 1,
+  HID_REPLAY_SCALED   = 2
+};
+
+// The transfer primitives a hid_libusb is driven by.  Transfers are
+// filled with the libusb helpers and complete through their callback,
+// which runs from within handleEvents(), so the input and output
+// pipelines of hid_libusb work the same on every transport.
+class hid_transport
+{
+public:
+
+  virtual ~hid_transport() {}
+
+  // the libusb_*_transfer() calls, with the same return values
+  virtual struct libusb_transfer *allocTransfer() = 0;
+  virtual void freeTransfer(struct libusb_transfer *pTransfer) = 0;
+  virtual int submitTransfer(struct libusb_transfer *pTransfer) = 0;
+  virtual int cancelTransfer(struct libusb_transfer *pTransfer) = 0;
+  // Runs the callbacks of completed transfers, waits up to *pTimeout for
+  // the first one.  Only called by the thread reading the device.
+  virtual int handleEvents(struct timeval *pTimeout) = 0;
+  // synchronous, like libusb_control_transfer()
+  virtual int controlTransfer(const uint8_t uiRequestType,
+                              const uint8_t uiRequest,
+                              const uint16_t uiValue,
+                              const uint16_t uiIndex,
+                              uint8_t *puiData, const uint16_t uiLength,
+                              const unsigned int uiTimeout) = 0;
+  // size of the largest input report
+  virtual size_t reportSize() const = 0;
+  // stands in for the serial number in captures
+  virtual std::string getName() const = 0;
+};
+
+// A claimed interface of a real device.  The handle stays owned by the
+// hid_libusb, events are those of the whole libusb context.
+class hid_libusb_transport : public hid_transport
+{
+private:
+
+  typedef class hid_libusb_transport self_type_t;
+
+  libusb_context                 *m_pContext;
+  libusb_device_handle           *m_pDeviceHandle;
+  size_t                          m_uiReportSize;
+  std::string                     m_Name;
+
+  hid_libusb_transport(const hid_libusb_transport &);
+  hid_libusb_transport &operator=(const hid_libusb_transport &);
+
+public:
+
+  hid_libusb_transport(libusb_context *pContext,
+                       libusb_device_handle *pDeviceHandle,
+                       const size_t uiReportSize, std::string const& name);
+
+  virtual struct libusb_transfer *allocTransfer();
+  virtual void freeTransfer(struct libusb_transfer *pTransfer);
+  virtual int submitTransfer(struct libusb_transfer *pTransfer);
+  virtual int cancelTransfer(struct libusb_transfer *pTransfer);
+  virtual int handleEvents(struct timeval *pTimeout);
+  virtual int controlTransfer(const uint8_t uiRequestType,
+                              const uint8_t uiRequest,
+                              const uint16_t uiValue,
+                              const uint16_t uiIndex,
+                              uint8_t *puiData, const uint16_t uiLength,
+                              const unsigned int uiTimeout);
+  virtual size_t reportSize() const;
+  virtual std::string getName() const;
+};
+
+// Device without libusb underneath, see hid_libusb::openTransport().  It
+// has one interrupt IN and one interrupt OUT endpoint.  Submitted IN
+// transfers are filled by nextReport() of the subclass, OUT transfers
+// are taken as they come, or echoed back as input reports if echoes are
+// enabled.  Echoes wait in a ring of HID_MOCK_ECHO_DEPTH reports, an OUT
+// transfer that finds it full stays pending until one is read back or it
+// times out.  Control transfers are feature reports, written ones are
+// taken if the device is writable, reading them is not supported.
+class hid_emulated_transport : public hid_transport
+{
+private:
+
+  typedef class hid_emulated_transport self_type_t;
+
+  // in front of every libusb_transfer this transport allocates
+  typedef struct emulated_transfer
+  {
+    struct emulated_transfer *pNext;
+    uint64_t                  uiDeadline;
+    bool                      bPending;
+    bool                      bCancelled;
+    struct libusb_transfer    transfer;
+  } emulated_transfer_t;
+
+  typedef struct transfer_list
+  {
+    emulated_transfer_t      *pHead;
+    emulated_transfer_t      *pTail;
+  } transfer_list_t;
+
+  pthread_mutex_t                 m_Mutex;
+  pthread_cond_t                  m_Condition;
+  transfer_list_t                 m_Input;
+  transfer_list_t                 m_Output;
+  size_t                          m_uiReportSize;
+  bool                            m_bWritable;
+  bool                            m_bGone;
+  std::vector<uint8_t>            m_Echoes;
+  std::vector<size_t>             m_EchoLengths;
+  size_t                          m_uiEchoHead;
+  size_t                          m_uiEchoCount;
+
+  static emulated_transfer_t *fromTransfer(struct libusb_transfer *);
+  static void append(transfer_list_t *, emulated_transfer_t *);
+  static emulated_transfer_t *take(transfer_list_t *);
+  static void finish(emulated_transfer_t *, const libusb_transfer_status,
+                     transfer_list_t *);
+  void expire(transfer_list_t *, const uint64_t, uint64_t *,
+              transfer_list_t *);
+  uint64_t collect(const uint64_t, transfer_list_t *);
+
+  hid_emulated_transport(const hid_emulated_transport &);
+  hid_emulated_transport &operator=(const hid_emulated_transport &);
+
+protected:
+
+  const bool                      m_bEcho;
+
+  // Called with the transport locked.  Returns 1 with the next input
+  // report in puiData and *puiLength, 0 if nothing is due before *pDue
+  // (CLOCK_MONOTONIC), or a negative error once no report will follow,
+  // which unplugs the device.
+  virtual int nextReport(uint8_t *puiData, size_t *puiLength,
+                         struct timespec *pDue) = 0;
+
+public:
+
+  hid_emulated_transport(const size_t uiReportSize, const bool bWritable,
+                         const bool bEcho);
+  virtual ~hid_emulated_transport();
+
+  virtual struct libusb_transfer *allocTransfer();
+  virtual void freeTransfer(struct libusb_transfer *pTransfer);
+  virtual int submitTransfer(struct libusb_transfer *pTransfer);
+  virtual int cancelTransfer(struct libusb_transfer *pTransfer);
+  virtual int handleEvents(struct timeval *pTimeout);
+  virtual int controlTransfer(const uint8_t uiRequestType,
+                              const uint8_t uiRequest,
+                              const uint16_t uiValue,
+                              const uint16_t uiIndex,
+                              uint8_t *puiData, const uint16_t uiLength,
+                              const unsigned int uiTimeout);
+  virtual size_t reportSize() const;
+};
+
+// Serves the input reports of a capture file, paced like they were
+// recorded, faster or without any pause.  Nothing can be written to it.
+class hid_replay_transport : public hid_emulated_transport
+{
+private:
+
+  typedef class hid_replay_transport self_type_t;
+
+  hid_capture_reader              m_Reader;
+  std::string                     m_Path;
+  hid_replay_speed                m_eSpeed;
+  double                          m_dScale;
+  int                             m_iDevice;
+  capture_record_t                m_Record;
+  std::vector<uint8_t>            m_Payload;
+  bool                            m_bPending;
+  bool                            m_bStarted;
+  uint64_t                        m_uiFirst;
+  struct timespec                 m_Start;
+
+  hid_replay_transport(const hid_replay_transport &);
+  hid_replay_transport &operator=(const hid_replay_transport &);
+
+protected:
+
+  virtual int nextReport(uint8_t *puiData, size_t *puiLength,
+                         struct timespec *pDue);
+
+public:
+
+  hid_replay_transport(const hid_replay_speed eSpeed, const double dScale,
+                       const int iDevice);
+
+  int open(std::string const& path);
+  virtual std::string getName() const;
+};
+
+// Synthetic device.  Generates uiReports input reports of uiReportSize
+// bytes at dRate reports per second, or as fast as they are taken with a
+// rate of 0.  Each one is delayed by up to uiJitterUs microseconds.  A
+// generated report holds uiReportID, a 32 bit sequence number and the 64
+// bit CLOCK_MONOTONIC time it was due, as far as it is long enough.
+// Output reports are echoed back as input reports if bEcho is set, cut
+// to uiReportSize.  An echoing mock never ends, otherwise the device is
+// gone after the last generated report.
+class hid_mock_transport : public hid_emulated_transport
+{
+private:
+
+  typedef class hid_mock_transport self_type_t;
+
+  double                          m_dRate;
+  uint32_t                        m_uiJitterUs;
+  uint64_t                        m_uiReports;
+  uint8_t                         m_uiReportID;
+  uint64_t                        m_uiGenerated;
+  uint64_t                        m_uiRandom;
+  uint64_t                        m_uiJitter;
+  struct timespec                 m_Start;
+  bool                            m_bStarted;
+
+  uint32_t nextRandom();
+
+  hid_mock_transport(const hid_mock_transport &);
+  hid_mock_transport &operator=(const hid_mock_transport &);
+
+protected:
+
+  virtual int nextReport(uint8_t *puiData, size_t *puiLength,
+                         struct timespec *pDue);
+
+public:
+
+  hid_mock_transport(const double dRate, const size_t uiReportSize,
+                     const uint32_t uiJitterUs = 0,
+                     const uint64_t uiReports = HID_MOCK_UNLIMITED,
+                     const bool bEcho = true,
+                     const uint8_t uiReportID = 1);
+
+  virtual std::string getName() const;
+};
+
+#endif
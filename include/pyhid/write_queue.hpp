@@ -0,0 +1,93 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2026 TU-Dresden  All rights reserved.
+//
+// Unless otherwise stated, the software on this site is distributed
+// in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+// without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. THERE IS NO WARRANTY FOR THE SOFTWARE,
+// TO THE EXTENT PERMITTED BY APPLICABLE LAW. EXCEPT WHEN OTHERWISE
+// STATED IN WRITING THE COPYRIGHT HOLDERS PROVIDE THE SOFTWARE
+// "AS IS" WITHOUT WARRANTY OF ANY KIND, EITHER EXPRESSED OR IMPLIED,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE ENTIRE
+// RISK AS TO THE QUALITY AND PERFORMANCE OF THE SOFTWARE IS WITH YOU.
+// SHOULD THE SOFTWARE PROVE DEFECTIVE, YOU ASSUME THE COST OF ALL
+// NECESSARY SERVICING, REPAIR OR CORRECTION. IN NO EVENT UNLESS
+// REQUIRED BY APPLICABLE LAW OR AGREED TO IN WRITING WILL ANY
+// COPYRIGHT HOLDER, BE LIABLE TO YOU FOR DAMAGES, INCLUDING ANY
+// GENERAL, SPECIAL, INCIDENTAL OR CONSEQUENTIAL DAMAGES ARISING OUT
+// OF THE USE OR INABILITY TO USE THE SOFTWARE (INCLUDING BUT NOT
+// LIMITED TO LOSS OF DATA OR DATA BEING RENDERED INACCURATE OR LOSSES
+// SUSTAINED BY YOU OR THIRD PARTIES OR A FAILURE OF THE SOFTWARE TO
+// OPERATE WITH ANY OTHER PROGRAMS), EVEN IF SUCH HOLDER HAS BEEN
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+//
+//-----------------------------------------------------------------
+
+// Company           :   TU-Dresden
+//
+// Filename          :   write_queue.hpp
+// Project Name      :   PyHID
+// Description       :   Lock-free output report queue
+//-----------------------------------------------------------------
+#ifndef __WRITE_QUEUE_HPP__
+#define __WRITE_QUEUE_HPP__
+
+#include <stdint.h>
+#include <cstddef>
+#include <atomic>
+
+#define HID_LIBUSB_DEFAULT_OUTPUT_DEPTH 4
+
+// Completion handler of hid_libusb::writeHIDAsync(), called on the libusb
+// event thread with the number of bytes written or a negative error code.
+typedef void (*hid_write_callback_t)(int, void *);
+
+typedef struct write_request
+{
+  std::atomic<struct write_request *> pNext;
+  hid_write_callback_t pCallback;
+  void                *pUserData;
+  uint8_t             *puiBuffer;
+  size_t               uiLength;
+  bool                 bSkippedReportID;
+} write_request_t;
+
+// Intrusive multi-producer single-consumer queue of output reports.
+// push() is wait-free and may be called from any thread; pop() must only
+// be called by one thread at a time.
+//
+// Producers swap themselves in as the new back and link the previous
+// one afterwards.  Until that link is made the consumer sees the queue
+// end there, so every producer has to make sure its report gets popped
+// after push() returned (see hid_libusb::drainWrites()).
+class hid_write_queue
+{
+private:
+
+  typedef class hid_write_queue self_type_t;
+
+  std::atomic<write_request_t *>  m_pBack;
+  char                            m_cPadBack[64 - sizeof(void *)];
+  write_request_t                *m_pFront;
+  std::atomic<size_t>             m_uiSize;
+  write_request_t                 m_Stub;
+
+  void link(write_request_t *);
+
+  hid_write_queue(const hid_write_queue &);
+  hid_write_queue &operator=(const hid_write_queue &);
+
+public:
+
+  hid_write_queue();
+
+  void push(write_request_t *);
+  write_request_t *pop();
+
+  bool empty() const { return !this->m_uiSize.load(); }
+  size_t size() const { return this->m_uiSize.load(); }
+};
+
+#endif
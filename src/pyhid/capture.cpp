@@ -0,0 +1,679 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2026 TU-Dresden  All rights reserved.
+//
+// Unless otherwise stated, the software on this site is distributed
+// in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+// without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. THERE IS NO WARRANTY FOR THE SOFTWARE,
+// TO THE EXTENT PERMITTED BY APPLICABLE LAW. EXCEPT WHEN OTHERWISE
+// STATED IN WRITING THE COPYRIGHT HOLDERS PROVIDE THE SOFTWARE
+// "AS IS" WITHOUT WARRANTY OF ANY KIND, EITHER EXPRESSED OR IMPLIED,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE ENTIRE
+// RISK AS TO THE QUALITY AND PERFORMANCE OF THE SOFTWARE IS WITH YOU.
+// SHOULD THE SOFTWARE PROVE DEFECTIVE, YOU ASSUME THE COST OF ALL
+// NECESSARY SERVICING, REPAIR OR CORRECTION. IN NO EVENT UNLESS
+// REQUIRED BY APPLICABLE LAW OR AGREED TO IN WRITING WILL ANY
+// COPYRIGHT HOLDER, BE LIABLE TO YOU FOR DAMAGES, INCLUDING ANY
+// GENERAL, SPECIAL, INCIDENTAL OR CONSEQUENTIAL DAMAGES ARISING OUT
+// OF THE USE OR INABILITY TO USE THE SOFTWARE (INCLUDING BUT NOT
+// LIMITED TO LOSS OF DATA OR DATA BEING RENDERED INACCURATE OR LOSSES
+// SUSTAINED BY YOU OR THIRD PARTIES OR A FAILURE OF THE SOFTWARE TO
+// OPERATE WITH ANY OTHER PROGRAMS), EVEN IF SUCH HOLDER HAS BEEN
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+//
+//-----------------------------------------------------------------
+
+// Company           :   TU-Dresden
+//
+// Filename          :   capture.cpp
+// Project Name      :   PyHID
+// Description       :   Binary capture of device traffic
+//-----------------------------------------------------------------
+#include "pyhid/capture.hpp"
+#include "pyhid/hid_libusb.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+
+static const char s_szFileMagic[8] = { 'P', 'Y', 'H', 'I', 'D', 'C', 'A', 'P' };
+static const char s_szIndexMagic[8] = { 'P', 'Y', 'H', 'I', 'D', 'I', 'D', 'X' };
+
+static size_t recordStride(const size_t uiSize)
+{
+  return ( uiSize + 7 ) & ~(size_t)7;
+}
+
+// Appends one padded record to a buffer written in a single piece.
+static void packRecord(std::vector<uint8_t> &buffer, const uint16_t uiDevice,
+                       const uint8_t uiKind, const uint64_t uiTimestamp,
+                       const uint8_t *puiData, size_t uiLength)
+{
+  capture_record_t record;
+  record.uiSize = sizeof(record) + uiLength;
+  record.uiDevice = uiDevice;
+  record.uiKind = uiKind;
+  record.uiReserved = 0;
+  record.uiTimestamp = uiTimestamp;
+
+  const size_t uiOffset = buffer.size();
+  buffer.resize(uiOffset + recordStride(record.uiSize), 0);
+  memcpy(&buffer[uiOffset], &record, sizeof(record));
+  if ( uiLength )
+    memcpy(&buffer[uiOffset + sizeof(record)], puiData, uiLength);
+}
+
+// Writes all of the vectors, false on an error.
+static bool writeFully(int iFile, struct iovec *pVectors, int iVectors)
+{
+  while ( iVectors > 0 )
+    {
+      ssize_t iWritten = writev(iFile, pVectors, iVectors);
+      if ( iWritten < 0 )
+        {
+          if ( errno == EINTR )
+            continue;
+          return false;
+        }
+      while ( iVectors > 0 && (size_t)iWritten >= pVectors->iov_len )
+        {
+          iWritten -= pVectors->iov_len;
+          pVectors++;
+          iVectors--;
+        }
+      if ( iVectors > 0 )
+        {
+          pVectors->iov_base = static_cast<uint8_t *>(pVectors->iov_base) + iWritten;
+          pVectors->iov_len -= iWritten;
+        }
+    }
+
+  return true;
+}
+
+hid_capture::hid_capture() : m_uiReserved(0),
+                             m_uiFlushed(0),
+                             m_iProducers(0),
+                             m_bOpen(false),
+                             m_bStopWriter(false),
+                             m_uiRecords(0),
+                             m_uiDropped(0),
+                             m_uiBytesWritten(0),
+                             m_puiRing(0),
+                             m_uiCapacity(0),
+                             m_iFile(-1),
+                             m_iWakeFd(-1),
+                             m_iError(0),
+                             m_uiIndexed(0)
+{
+  pthread_mutex_init(&this->m_Mutex, 0);
+}
+
+hid_capture::~hid_capture()
+{
+  this->close();
+  pthread_mutex_destroy(&this->m_Mutex);
+}
+
+int hid_capture::open(std::string const& path, const size_t uiBufferSize)
+{
+  if ( path.empty() || uiBufferSize < 4096 )
+    return HID_LIBUSB_INVALID_ARGS;
+
+  pthread_mutex_lock(&this->m_Mutex);
+  if ( this->m_puiRing )
+    {
+      pthread_mutex_unlock(&this->m_Mutex);
+      return HID_LIBUSB_INVALID_ARGS;
+    }
+
+  int iFile = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                     0644);
+  if ( iFile < 0 )
+    {
+      pthread_mutex_unlock(&this->m_Mutex);
+      return HID_LIBUSB_FILE_ERROR;
+    }
+
+  capture_file_header_t header;
+  memcpy(header.szMagic, s_szFileMagic, sizeof(header.szMagic));
+  header.uiVersion = HID_CAPTURE_VERSION;
+  header.uiHeaderSize = sizeof(header);
+  struct iovec vector = { &header, sizeof(header) };
+  this->m_iWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if ( !writeFully(iFile, &vector, 1) || this->m_iWakeFd < 0 )
+    {
+      if ( this->m_iWakeFd >= 0 )
+        ::close(this->m_iWakeFd);
+      this->m_iWakeFd = -1;
+      ::close(iFile);
+      pthread_mutex_unlock(&this->m_Mutex);
+      return HID_LIBUSB_FILE_ERROR;
+    }
+
+  // a power of two, positions are mapped into the ring by masking
+  this->m_uiCapacity = 4096;
+  while ( this->m_uiCapacity < uiBufferSize )
+    this->m_uiCapacity <<= 1;
+  this->m_puiRing = new uint8_t[this->m_uiCapacity];
+  memset(this->m_puiRing, 0, this->m_uiCapacity);
+  this->m_iFile = iFile;
+  this->m_iError = 0;
+  this->m_uiReserved = 0;
+  this->m_uiFlushed = 0;
+  this->m_uiRecords = 0;
+  this->m_uiDropped = 0;
+  this->m_uiBytesWritten = sizeof(header);
+  this->m_Index.clear();
+  this->m_uiIndexed = 0;
+  this->m_bStopWriter = false;
+
+  // devices already known are announced before any of their reports
+  for ( size_t i = 0; i < this->m_Devices.size(); i++ )
+    this->append(i, HID_CAPTURE_DEVICE, 0, this->m_Devices[i].data(),
+                 this->m_Devices[i].size());
+
+  if ( pthread_create(&this->m_Writer, 0, self_type_t::writerThread, this) )
+    {
+      delete [] this->m_puiRing;
+      this->m_puiRing = 0;
+      ::close(this->m_iWakeFd);
+      this->m_iWakeFd = -1;
+      ::close(this->m_iFile);
+      this->m_iFile = -1;
+      pthread_mutex_unlock(&this->m_Mutex);
+      return HID_LIBUSB_FILE_ERROR;
+    }
+  this->m_bOpen = true;
+  pthread_mutex_unlock(&this->m_Mutex);
+
+  return 0;
+}
+
+int hid_capture::close()
+{
+  pthread_mutex_lock(&this->m_Mutex);
+  if ( !this->m_puiRing )
+    {
+      pthread_mutex_unlock(&this->m_Mutex);
+      return 0;
+    }
+
+  // wait for the producers that saw the capture still open, the writer
+  // picks up what they leave behind
+  this->m_bOpen = false;
+  while ( this->m_iProducers.load() )
+    sched_yield();
+  this->m_bStopWriter = true;
+  this->wakeWriter();
+  pthread_join(this->m_Writer, 0);
+
+  // device table and time index for readers that want to seek
+  const uint64_t uiDevicesOffset =
+    sizeof(capture_file_header_t) + this->m_uiFlushed.load();
+  std::vector<uint8_t> devices;
+  for ( size_t i = 0; i < this->m_Devices.size(); i++ )
+    packRecord(devices, i, HID_CAPTURE_DEVICE, 0, this->m_Devices[i].data(),
+               this->m_Devices[i].size());
+
+  capture_trailer_t trailer;
+  trailer.uiIndexOffset = uiDevicesOffset + devices.size();
+  trailer.uiEntries = this->m_Index.size();
+  trailer.uiDevicesOffset = uiDevicesOffset;
+  trailer.uiDevices = this->m_Devices.size();
+  memcpy(trailer.szMagic, s_szIndexMagic, sizeof(trailer.szMagic));
+
+  struct iovec aVectors[3];
+  aVectors[0].iov_base = devices.data();
+  aVectors[0].iov_len = devices.size();
+  aVectors[1].iov_base = this->m_Index.data();
+  aVectors[1].iov_len = this->m_Index.size() * sizeof(capture_index_entry_t);
+  aVectors[2].iov_base = &trailer;
+  aVectors[2].iov_len = sizeof(trailer);
+  if ( !this->m_iError )
+    {
+      if ( writeFully(this->m_iFile, aVectors, 3) )
+        this->m_uiBytesWritten += aVectors[0].iov_len + aVectors[1].iov_len +
+          sizeof(trailer);
+      else
+        this->m_iError = HID_LIBUSB_FILE_ERROR;
+    }
+  if ( ::close(this->m_iFile) < 0 && !this->m_iError )
+    this->m_iError = HID_LIBUSB_FILE_ERROR;
+  this->m_iFile = -1;
+  ::close(this->m_iWakeFd);
+  this->m_iWakeFd = -1;
+  delete [] this->m_puiRing;
+  this->m_puiRing = 0;
+  const int iResult = this->m_iError;
+  pthread_mutex_unlock(&this->m_Mutex);
+
+  return iResult;
+}
+
+bool hid_capture::isOpen() const
+{
+  return this->m_bOpen.load();
+}
+
+int hid_capture::addDevice(const uint16_t uiVendorID,
+                           const uint16_t uiProductID,
+                           const uint16_t uiBusNumber,
+                           const uint16_t uiDeviceAddress,
+                           const int32_t iInterfaceNumber,
+                           const char *szSerial)
+{
+  capture_device_t device;
+  device.uiVendorID = uiVendorID;
+  device.uiProductID = uiProductID;
+  device.uiBusNumber = uiBusNumber;
+  device.uiDeviceAddress = uiDeviceAddress;
+  device.iInterfaceNumber = iInterfaceNumber;
+  const uint8_t *puiDevice = reinterpret_cast<const uint8_t *>(&device);
+  std::vector<uint8_t> entry(puiDevice, puiDevice + sizeof(device));
+  if ( szSerial )
+    entry.insert(entry.end(), szSerial, szSerial + strlen(szSerial));
+
+  pthread_mutex_lock(&this->m_Mutex);
+  // a device opened again keeps its id
+  size_t uiDevice = 0;
+  while ( uiDevice < this->m_Devices.size() &&
+          this->m_Devices[uiDevice] != entry )
+    uiDevice++;
+  int iResult = uiDevice;
+  if ( uiDevice > 0xffff )
+    iResult = HID_LIBUSB_INVALID_ARGS;
+  else if ( uiDevice == this->m_Devices.size() )
+    {
+      this->m_Devices.push_back(entry);
+      if ( this->m_bOpen )
+        this->append(uiDevice, HID_CAPTURE_DEVICE, 0, entry.data(),
+                     entry.size());
+    }
+  pthread_mutex_unlock(&this->m_Mutex);
+
+  return iResult;
+}
+
+bool hid_capture::record(const uint16_t uiDevice, const hid_capture_kind eKind,
+                         const uint64_t uiTimestamp, const uint8_t *puiData,
+                         size_t uiLength)
+{
+  // keeps close() from freeing the ring while we write into it
+  this->m_iProducers.fetch_add(1);
+  bool bResult = false;
+  if ( this->m_bOpen.load() )
+    bResult = this->append(uiDevice, eKind, uiTimestamp, puiData, uiLength);
+  this->m_iProducers.fetch_sub(1);
+
+  return bResult;
+}
+
+void hid_capture::copyIn(const uint64_t uiPosition, const void *pData,
+                         size_t uiLength)
+{
+  const size_t uiOffset = uiPosition & ( this->m_uiCapacity - 1 );
+  size_t uiFirst = this->m_uiCapacity - uiOffset;
+  if ( uiFirst > uiLength )
+    uiFirst = uiLength;
+  memcpy(this->m_puiRing + uiOffset, pData, uiFirst);
+  memcpy(this->m_puiRing, static_cast<const uint8_t *>(pData) + uiFirst,
+         uiLength - uiFirst);
+}
+
+void hid_capture::copyOut(const uint64_t uiPosition, void *pData,
+                          size_t uiLength) const
+{
+  const size_t uiOffset = uiPosition & ( this->m_uiCapacity - 1 );
+  size_t uiFirst = this->m_uiCapacity - uiOffset;
+  if ( uiFirst > uiLength )
+    uiFirst = uiLength;
+  memcpy(pData, this->m_puiRing + uiOffset, uiFirst);
+  memcpy(static_cast<uint8_t *>(pData) + uiFirst, this->m_puiRing,
+         uiLength - uiFirst);
+}
+
+void hid_capture::wakeWriter()
+{
+  const uint64_t uiValue = 1;
+  if ( write(this->m_iWakeFd, &uiValue, sizeof(uiValue)) < 0 )
+    return;
+}
+
+bool hid_capture::append(const uint16_t uiDevice, const uint8_t uiKind,
+                         const uint64_t uiTimestamp, const uint8_t *puiData,
+                         size_t uiLength)
+{
+  const size_t uiSize = sizeof(capture_record_t) + uiLength;
+  const size_t uiStride = recordStride(uiSize);
+  if ( uiStride > this->m_uiCapacity / 2 )
+    {
+      this->m_uiDropped++;
+      return false;
+    }
+
+  // Claim the space, a record that does not fit is dropped instead of
+  // waiting for the writer.
+  uint64_t uiPosition = this->m_uiReserved.load(std::memory_order_relaxed);
+  uint64_t uiFlushed;
+  do
+    {
+      uiFlushed = this->m_uiFlushed.load(std::memory_order_acquire);
+      if ( uiPosition + uiStride - uiFlushed > this->m_uiCapacity )
+        {
+          this->m_uiDropped++;
+          this->wakeWriter();
+          return false;
+        }
+    }
+  while ( !this->m_uiReserved.compare_exchange_weak(uiPosition,
+                                                    uiPosition + uiStride,
+                                                    std::memory_order_relaxed) );
+
+  capture_record_t record;
+  record.uiDevice = uiDevice;
+  record.uiKind = uiKind;
+  record.uiReserved = 0;
+  record.uiTimestamp = uiTimestamp;
+  // everything but the size, which publishes the record
+  copyIn(uiPosition + sizeof(record.uiSize), &record.uiDevice,
+         sizeof(record) - sizeof(record.uiSize));
+  if ( uiLength )
+    copyIn(uiPosition + sizeof(record), puiData, uiLength);
+  // records are 8 byte aligned, the size never wraps around the ring
+  __atomic_store_n(reinterpret_cast<uint32_t *>(
+                     this->m_puiRing + ( uiPosition & ( this->m_uiCapacity - 1 ) )),
+                   (uint32_t)uiSize, __ATOMIC_RELEASE);
+
+  // wake the writer early once half of the ring is in use
+  const size_t uiHalf = this->m_uiCapacity / 2;
+  if ( uiPosition - uiFlushed < uiHalf &&
+       uiPosition + uiStride - uiFlushed >= uiHalf )
+    this->wakeWriter();
+
+  return true;
+}
+
+void hid_capture::flush()
+{
+  const uint64_t uiFlushed = this->m_uiFlushed.load(std::memory_order_relaxed);
+  const uint64_t uiReserved = this->m_uiReserved.load(std::memory_order_acquire);
+
+  // stop at the first record that is reserved but not written yet
+  uint64_t uiPosition = uiFlushed;
+  uint64_t uiRecords = 0;
+  while ( uiPosition < uiReserved )
+    {
+      const uint32_t uiSize = __atomic_load_n(
+        reinterpret_cast<uint32_t *>(
+          this->m_puiRing + ( uiPosition & ( this->m_uiCapacity - 1 ) )),
+        __ATOMIC_ACQUIRE);
+      if ( !uiSize )
+        break;
+
+      capture_record_t record;
+      this->copyOut(uiPosition, &record, sizeof(record));
+      if ( record.uiKind != HID_CAPTURE_DEVICE &&
+           ( this->m_Index.empty() ||
+             uiPosition - this->m_uiIndexed >= HID_CAPTURE_INDEX_INTERVAL ) )
+        {
+          // Records are reserved a little after they were stamped, the
+          // index stays sorted for seek() anyway.
+          capture_index_entry_t entry;
+          entry.uiTimestamp = record.uiTimestamp;
+          if ( !this->m_Index.empty() &&
+               entry.uiTimestamp < this->m_Index.back().uiTimestamp )
+            entry.uiTimestamp = this->m_Index.back().uiTimestamp;
+          entry.uiOffset = sizeof(capture_file_header_t) + uiPosition;
+          this->m_Index.push_back(entry);
+          this->m_uiIndexed = uiPosition;
+        }
+      uiPosition += recordStride(uiSize);
+      uiRecords++;
+    }
+  if ( uiPosition == uiFlushed )
+    return;
+
+  // at most two pieces, the range may wrap around the end of the ring
+  const size_t uiOffset = uiFlushed & ( this->m_uiCapacity - 1 );
+  const size_t uiLength = uiPosition - uiFlushed;
+  size_t uiFirst = this->m_uiCapacity - uiOffset;
+  if ( uiFirst > uiLength )
+    uiFirst = uiLength;
+  struct iovec aVectors[2];
+  aVectors[0].iov_base = this->m_puiRing + uiOffset;
+  aVectors[0].iov_len = uiFirst;
+  aVectors[1].iov_base = this->m_puiRing;
+  aVectors[1].iov_len = uiLength - uiFirst;
+  if ( !this->m_iError )
+    {
+      // after an error the records are still consumed, the producers
+      // must not run out of space
+      if ( writeFully(this->m_iFile, aVectors, 2) )
+        this->m_uiBytesWritten += uiLength;
+      else
+        this->m_iError = HID_LIBUSB_FILE_ERROR;
+    }
+
+  // a zero size marks space that is free or not written yet
+  memset(this->m_puiRing + uiOffset, 0, uiFirst);
+  memset(this->m_puiRing, 0, uiLength - uiFirst);
+  this->m_uiRecords += uiRecords;
+  this->m_uiFlushed.store(uiPosition, std::memory_order_release);
+}
+
+void *hid_capture::writerThread(void *pParam)
+{
+  self_type_t *pThis = static_cast<self_type_t *>(pParam);
+
+  struct pollfd wake;
+  wake.fd = pThis->m_iWakeFd;
+  wake.events = POLLIN;
+  while ( true )
+    {
+      // the last pass runs after all producers are gone
+      const bool bStop = pThis->m_bStopWriter.load();
+      if ( !bStop && poll(&wake, 1, HID_CAPTURE_FLUSH_MS) > 0 )
+        {
+          uint64_t uiValue;
+          if ( read(pThis->m_iWakeFd, &uiValue, sizeof(uiValue)) < 0 )
+            {
+              // EAGAIN, woken by someone else
+            }
+        }
+      pThis->flush();
+      if ( bStop )
+        break;
+    }
+
+  return 0;
+}
+
+uint64_t hid_capture::getRecords() const
+{
+  return this->m_uiRecords.load();
+}
+
+uint64_t hid_capture::getDroppedRecords() const
+{
+  return this->m_uiDropped.load();
+}
+
+uint64_t hid_capture::getBytesWritten() const
+{
+  return this->m_uiBytesWritten.load();
+}
+
+hid_capture_reader::hid_capture_reader() : m_iFile(-1),
+                                           m_Buffer(),
+                                           m_uiBegin(0),
+                                           m_uiEnd(0),
+                                           m_uiOffset(0),
+                                           m_uiRecordsEnd(0),
+                                           m_Index()
+{
+}
+
+hid_capture_reader::~hid_capture_reader()
+{
+  this->close();
+}
+
+int hid_capture_reader::open(std::string const& path)
+{
+  this->close();
+
+  this->m_iFile = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if ( this->m_iFile < 0 )
+    return HID_LIBUSB_FILE_ERROR;
+
+  capture_file_header_t header;
+  struct stat status;
+  if ( pread(this->m_iFile, &header, sizeof(header), 0) != sizeof(header) ||
+       memcmp(header.szMagic, s_szFileMagic, sizeof(header.szMagic)) ||
+       header.uiVersion != HID_CAPTURE_VERSION ||
+       header.uiHeaderSize < sizeof(header) ||
+       fstat(this->m_iFile, &status) < 0 )
+    {
+      this->close();
+      return HID_LIBUSB_FILE_ERROR;
+    }
+
+  // without a trailer the capture was never closed, every complete
+  // record up to the end of the file is used
+  this->m_uiRecordsEnd = status.st_size;
+  capture_trailer_t trailer;
+  if ( (uint64_t)status.st_size >= header.uiHeaderSize + sizeof(trailer) &&
+       pread(this->m_iFile, &trailer, sizeof(trailer),
+             status.st_size - sizeof(trailer)) == sizeof(trailer) &&
+       !memcmp(trailer.szMagic, s_szIndexMagic, sizeof(trailer.szMagic)) )
+    {
+      // the index lies in front of the trailer, a damaged trailer must
+      // not make us allocate for more
+      const uint64_t uiIndexEnd = status.st_size - sizeof(trailer);
+      if ( trailer.uiIndexOffset > uiIndexEnd ||
+           trailer.uiEntries > ( uiIndexEnd - trailer.uiIndexOffset ) /
+             sizeof(capture_index_entry_t) ||
+           trailer.uiDevicesOffset > trailer.uiIndexOffset )
+        {
+          this->close();
+          return HID_LIBUSB_FILE_ERROR;
+        }
+      this->m_uiRecordsEnd = trailer.uiDevicesOffset;
+      this->m_Index.resize(trailer.uiEntries);
+      const size_t uiIndexSize =
+        trailer.uiEntries * sizeof(capture_index_entry_t);
+      if ( pread(this->m_iFile, this->m_Index.data(), uiIndexSize,
+                 trailer.uiIndexOffset) != (ssize_t)uiIndexSize )
+        this->m_Index.clear();
+    }
+
+  this->m_Buffer.resize(HID_CAPTURE_DEFAULT_BUFFER);
+  this->m_uiBegin = this->m_uiEnd = 0;
+  this->m_uiOffset = header.uiHeaderSize;
+
+  return 0;
+}
+
+void hid_capture_reader::close()
+{
+  if ( this->m_iFile >= 0 )
+    ::close(this->m_iFile);
+  this->m_iFile = -1;
+  this->m_Index.clear();
+}
+
+int hid_capture_reader::fill(const size_t uiLength)
+{
+  if ( this->m_uiEnd - this->m_uiBegin >= uiLength )
+    return 1;
+
+  // keep what is left, read as much as fits behind it
+  memmove(this->m_Buffer.data(), this->m_Buffer.data() + this->m_uiBegin,
+          this->m_uiEnd - this->m_uiBegin);
+  this->m_uiEnd -= this->m_uiBegin;
+  this->m_uiBegin = 0;
+  if ( this->m_Buffer.size() < uiLength )
+    this->m_Buffer.resize(uiLength);
+
+  while ( this->m_uiEnd < uiLength )
+    {
+      const uint64_t uiPosition = this->m_uiOffset + this->m_uiEnd;
+      if ( uiPosition >= this->m_uiRecordsEnd )
+        return 0;
+      size_t uiWanted = this->m_Buffer.size() - this->m_uiEnd;
+      if ( uiWanted > this->m_uiRecordsEnd - uiPosition )
+        uiWanted = this->m_uiRecordsEnd - uiPosition;
+      const ssize_t iRead = pread(this->m_iFile,
+                                  this->m_Buffer.data() + this->m_uiEnd,
+                                  uiWanted, uiPosition);
+      if ( iRead < 0 && errno == EINTR )
+        continue;
+      if ( iRead < 0 )
+        return HID_LIBUSB_FILE_ERROR;
+      if ( !iRead )
+        return 0;
+      this->m_uiEnd += iRead;
+    }
+
+  return 1;
+}
+
+int hid_capture_reader::read(capture_record_t &record,
+                             std::vector<uint8_t> &payload)
+{
+  if ( this->m_iFile < 0 )
+    return HID_LIBUSB_FILE_ERROR;
+
+  int iResult = this->fill(sizeof(record));
+  if ( iResult <= 0 )
+    return iResult;
+  memcpy(&record, this->m_Buffer.data() + this->m_uiBegin, sizeof(record));
+  if ( record.uiSize < sizeof(record) )
+    return HID_LIBUSB_FILE_ERROR;
+
+  // a record cut off at the end of an unclosed capture ends it as well
+  const size_t uiStride = recordStride(record.uiSize);
+  iResult = this->fill(uiStride);
+  if ( iResult <= 0 )
+    return iResult;
+  const uint8_t *puiPayload =
+    this->m_Buffer.data() + this->m_uiBegin + sizeof(record);
+  payload.assign(puiPayload, puiPayload + record.uiSize - sizeof(record));
+  this->m_uiBegin += uiStride;
+  this->m_uiOffset += uiStride;
+
+  return 1;
+}
+
+static bool entryBefore(const uint64_t uiTimestamp,
+                        const capture_index_entry_t &entry)
+{
+  return uiTimestamp < entry.uiTimestamp;
+}
+
+int hid_capture_reader::seek(const uint64_t uiTimestamp)
+{
+  if ( this->m_iFile < 0 || this->m_Index.empty() )
+    return HID_LIBUSB_FILE_ERROR;
+
+  std::vector<capture_index_entry_t>::const_iterator it =
+    std::upper_bound(this->m_Index.begin(), this->m_Index.end(), uiTimestamp,
+                     entryBefore);
+  if ( it != this->m_Index.begin() )
+    --it;
+  this->m_uiOffset = it->uiOffset;
+  this->m_uiBegin = this->m_uiEnd = 0;
+
+  return 0;
+}
@@ -0,0 +1,459 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2026 TU-Dresden  All rights reserved.
+//
+// Unless otherwise stated, the software on this site is distributed
+// in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+// without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. THERE IS NO WARRANTY FOR THE SOFTWARE,
+// TO THE EXTENT PERMITTED BY APPLICABLE LAW. EXCEPT WHEN OTHERWISE
+// STATED IN WRITING THE COPYRIGHT HOLDERS PROVIDE THE SOFTWARE
+// "AS IS" WITHOUT WARRANTY OF ANY KIND, EITHER EXPRESSED OR IMPLIED,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE ENTIRE
+// RISK AS TO THE QUALITY AND PERFORMANCE OF THE SOFTWARE IS WITH YOU.
+// SHOULD THE SOFTWARE PROVE DEFECTIVE, YOU ASSUME THE COST OF ALL
+// NECESSARY SERVICING, REPAIR OR CORRECTION. IN NO EVENT UNLESS
+// REQUIRED BY APPLICABLE LAW OR AGREED TO IN WRITING WILL ANY
+// COPYRIGHT HOLDER, BE LIABLE TO YOU FOR DAMAGES, INCLUDING ANY
+// GENERAL, SPECIAL, INCIDENTAL OR CONSEQUENTIAL DAMAGES ARISING OUT
+// OF THE USE OR INABILITY TO USE THE SOFTWARE (INCLUDING BUT NOT
+// LIMITED TO LOSS OF DATA OR DATA BEING RENDERED INACCURATE OR LOSSES
+// SUSTAINED BY YOU OR THIRD PARTIES OR A FAILURE OF THE SOFTWARE TO
+// OPERATE WITH ANY OTHER PROGRAMS), EVEN IF SUCH HOLDER HAS BEEN
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+//
+//-----------------------------------------------------------------
+
+// Company           :   TU-Dresden
+//
+// Filename          :   device_registry.cpp
+// Project Name      :   PyHID
+// Description       :   Process wide index of HID interfaces
+//-----------------------------------------------------------------
+#include "pyhid/device_registry.hpp"
+#include "pyhid/hid_libusb.hpp"
+
+#include <algorithm>
+#include <functional>
+
+bool hid_registry_key::operator==(const hid_registry_key &other) const
+{
+  return this->uiVendorID == other.uiVendorID &&
+         this->uiProductID == other.uiProductID &&
+         this->uiBusNumber == other.uiBusNumber &&
+         this->uiDeviceAddress == other.uiDeviceAddress &&
+         this->iInterfaceNumber == other.iInterfaceNumber &&
+         this->serial == other.serial;
+}
+
+size_t hid_registry_hash::operator()(const hid_registry_key_t &key) const
+{
+  uint64_t uiIdentity = ( (uint64_t)key.uiVendorID << 48 ) |
+                        ( (uint64_t)key.uiProductID << 32 ) |
+                        ( (uint64_t)key.uiBusNumber << 24 ) |
+                        ( (uint64_t)( key.uiDeviceAddress & 0xff ) << 16 ) |
+                        (uint16_t)key.iInterfaceNumber;
+  return std::hash<uint64_t>()(uiIdentity) * 31 +
+         std::hash<std::string>()(key.serial);
+}
+
+hid_device_registry::hid_device_registry() : m_pContext(0),
+                                             m_bAttached(false),
+                                             m_Callback()
+{
+  pthread_mutex_init(&this->m_Mutex, 0);
+  pthread_cond_init(&this->m_SerialCondition, 0);
+  pthread_mutex_init(&this->m_EventMutex, 0);
+}
+
+hid_device_registry::~hid_device_registry()
+{
+  this->detach();
+  pthread_mutex_destroy(&this->m_EventMutex);
+  pthread_cond_destroy(&this->m_SerialCondition);
+  pthread_mutex_destroy(&this->m_Mutex);
+}
+
+hid_device_registry &hid_device_registry::getInstance()
+{
+  static hid_device_registry myRegistry;
+  return myRegistry;
+}
+
+bool hid_device_registry::attach(libusb_context *pContext)
+{
+  libusb_wrapper &libusbWrapper = libusb_wrapper::getInstance();
+
+  pthread_mutex_lock(&this->m_Mutex);
+  if ( !this->m_bAttached && pContext &&
+       libusbWrapper.libusbHasCapability &&
+       libusbWrapper.libusbRefDevice && libusbWrapper.libusbUnrefDevice &&
+       libusbWrapper.libusbHotplugRegisterCallback &&
+       libusbWrapper.libusbHotplugDeregisterCallback &&
+       libusbWrapper.libusbHasCapability(LIBUSB_CAP_HAS_HOTPLUG) )
+    {
+      this->m_pContext = pContext;
+      // the devices already present arrive right here
+      this->m_bAttached =
+        libusbWrapper.libusbHotplugRegisterCallback(
+                          pContext,
+                          LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED |
+                          LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+                          LIBUSB_HOTPLUG_ENUMERATE,
+                          LIBUSB_HOTPLUG_MATCH_ANY,
+                          LIBUSB_HOTPLUG_MATCH_ANY,
+                          LIBUSB_HOTPLUG_MATCH_ANY,
+                          self_type_t::hotplugCallback, this,
+                          &this->m_Callback) == LIBUSB_SUCCESS;
+      if ( !this->m_bAttached )
+        this->m_pContext = 0;
+    }
+  const bool bAttached = this->m_bAttached && this->m_pContext == pContext;
+  pthread_mutex_unlock(&this->m_Mutex);
+
+  return bAttached;
+}
+
+void hid_device_registry::detach()
+{
+  libusb_wrapper &libusbWrapper = libusb_wrapper::getInstance();
+
+  pthread_mutex_lock(&this->m_Mutex);
+  if ( this->m_bAttached )
+    {
+      libusbWrapper.libusbHotplugDeregisterCallback(this->m_pContext,
+                                                    this->m_Callback);
+      pthread_mutex_lock(&this->m_EventMutex);
+      for ( size_t i = 0; i < this->m_Events.size(); i++ )
+        libusbWrapper.libusbUnrefDevice(this->m_Events[i].first);
+      this->m_Events.clear();
+      pthread_mutex_unlock(&this->m_EventMutex);
+
+      for ( devices_t::iterator it = this->m_Devices.begin();
+            it != this->m_Devices.end(); ++it )
+        libusbWrapper.libusbUnrefDevice(it->first);
+      this->m_Devices.clear();
+      this->m_Interfaces.clear();
+      this->m_Serials.clear();
+      this->m_pContext = 0;
+      this->m_bAttached = false;
+    }
+  pthread_mutex_unlock(&this->m_Mutex);
+}
+
+int hid_device_registry::hotplugCallback(libusb_context *,
+                                         libusb_device *pDevice,
+                                         libusb_hotplug_event eEvent,
+                                         void *pUserData)
+{
+  self_type_t *pThis = static_cast<self_type_t *>(pUserData);
+
+  // only noted here, libusb does not want descriptors read on its thread
+  pthread_mutex_lock(&pThis->m_EventMutex);
+  pThis->m_Events.push_back(hid_registry_event_t(
+    libusb_wrapper::getInstance().libusbRefDevice(pDevice),
+    eEvent == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED));
+  pthread_mutex_unlock(&pThis->m_EventMutex);
+
+  return 0;
+}
+
+// called with m_Mutex held
+void hid_device_registry::update()
+{
+  libusb_wrapper &libusbWrapper = libusb_wrapper::getInstance();
+
+  // delivers the events nobody handled yet if no device is open
+  struct timeval tv;
+  tv.tv_sec = 0;
+  tv.tv_usec = 0;
+  libusbWrapper.libusbHandleEventsTimeout(this->m_pContext, &tv);
+
+  std::vector<hid_registry_event_t> events;
+  pthread_mutex_lock(&this->m_EventMutex);
+  events.swap(this->m_Events);
+  pthread_mutex_unlock(&this->m_EventMutex);
+
+  for ( size_t i = 0; i < events.size(); i++ )
+    {
+      if ( events[i].second )
+        this->addDevice(events[i].first);
+      else
+        this->removeDevice(events[i].first);
+      libusbWrapper.libusbUnrefDevice(events[i].first);
+    }
+}
+
+void hid_device_registry::addDevice(libusb_device *pDevice)
+{
+  libusb_wrapper &libusbWrapper = libusb_wrapper::getInstance();
+
+  if ( this->m_Devices.count(pDevice) )
+    return;
+
+  // the same selection as hid_libusb::enumerateHID()
+  struct libusb_device_descriptor desc;
+  if ( libusbWrapper.libusbGetDeviceDescriptor(pDevice, &desc) < 0 ||
+       ( desc.bDeviceClass != LIBUSB_CLASS_PER_INTERFACE &&
+         desc.bDeviceClass != LIBUSB_CLASS_VENDOR_SPEC ) )
+    return;
+
+  struct libusb_config_descriptor *pConfDesc = 0;
+  if ( libusbWrapper.libusbGetActiveConfigDescriptor(pDevice, &pConfDesc) < 0 )
+    libusbWrapper.libusbGetConfigDescriptor(pDevice, 0, &pConfDesc);
+  if ( !pConfDesc )
+    return;
+
+  hid_registry_key_t key;
+  key.uiVendorID = desc.idVendor;
+  key.uiProductID = desc.idProduct;
+  key.uiBusNumber = libusbWrapper.libusbGetBusNumber(pDevice);
+  key.uiDeviceAddress = libusbWrapper.libusbGetDeviceAddress(pDevice);
+
+  std::vector<hid_registry_key_t> keys;
+  for ( int j = 0; j < pConfDesc->bNumInterfaces; j++ )
+    {
+      const struct libusb_interface *pInterface = &pConfDesc->interface[j];
+      for ( int k = 0; k < pInterface->num_altsetting; k++ )
+        {
+          const struct libusb_interface_descriptor *pInterfaceDesc;
+          pInterfaceDesc = &pInterface->altsetting[k];
+          if ( pInterfaceDesc->bInterfaceClass == LIBUSB_CLASS_HID )
+            {
+              key.iInterfaceNumber = pInterfaceDesc->bInterfaceNumber;
+              if ( std::find(keys.begin(), keys.end(), key) == keys.end() )
+                keys.push_back(key);
+            }
+        }
+    }
+  libusbWrapper.libusbFreeConfigDescriptor(pConfDesc);
+  if ( keys.empty() )
+    return;
+
+  // indexed once its serial was read, see readSerials()
+  hid_registry_device_t &device =
+    this->m_Devices[libusbWrapper.libusbRefDevice(pDevice)];
+  device.keys.swap(keys);
+  device.uiSerialIndex = desc.iSerialNumber;
+  device.bIndexed = false;
+  device.bReading = false;
+  if ( !device.uiSerialIndex )
+    this->indexDevice(device, pDevice);
+}
+
+void hid_device_registry::indexDevice(hid_registry_device_t &device,
+                                      libusb_device *pDevice)
+{
+  std::vector<hid_registry_key_t> const& keys = device.keys;
+  for ( size_t i = 0; i < keys.size(); i++ )
+    {
+      this->m_Interfaces[keys[i]] = pDevice;
+      hid_registry_key_t serialKey = keys[i];
+      serialKey.uiBusNumber = 0;
+      serialKey.uiDeviceAddress = 0;
+      serialKey.iInterfaceNumber = 0;
+      this->m_Serials[serialKey].push_back(keys[i]);
+    }
+  device.bIndexed = true;
+}
+
+void hid_device_registry::removeDevice(libusb_device *pDevice)
+{
+  devices_t::iterator it = this->m_Devices.find(pDevice);
+  if ( it == this->m_Devices.end() )
+    return;
+
+  std::vector<hid_registry_key_t> const& keys = it->second.keys;
+  for ( size_t i = 0; i < keys.size() && it->second.bIndexed; i++ )
+    {
+      this->m_Interfaces.erase(keys[i]);
+      hid_registry_key_t serialKey = keys[i];
+      serialKey.uiBusNumber = 0;
+      serialKey.uiDeviceAddress = 0;
+      serialKey.iInterfaceNumber = 0;
+      serials_t::iterator serial = this->m_Serials.find(serialKey);
+      if ( serial != this->m_Serials.end() )
+        {
+          std::vector<hid_registry_key_t> &matches = serial->second;
+          matches.erase(std::remove(matches.begin(), matches.end(), keys[i]),
+                        matches.end());
+          if ( matches.empty() )
+            this->m_Serials.erase(serial);
+        }
+    }
+  this->m_Devices.erase(it);
+  libusb_wrapper::getInstance().libusbUnrefDevice(pDevice);
+}
+
+// the one time a device is opened by the registry, empty if it has no
+// readable serial
+std::string hid_device_registry::readSerial(libusb_device *pDevice,
+                                            const uint8_t uiSerialIndex)
+{
+  libusb_wrapper &libusbWrapper = libusb_wrapper::getInstance();
+
+  std::string serial;
+  libusb_device_handle *pDevHandle;
+  if ( libusbWrapper.libusbOpen(pDevice, &pDevHandle) >= 0 )
+    {
+      char szBuf[256];
+      const int iLen = libusbWrapper.libusbGetStringDescriptorAscii(
+                             pDevHandle, uiSerialIndex,
+                             (unsigned char *)szBuf, sizeof(szBuf));
+      libusbWrapper.libusbClose(pDevHandle);
+      if ( iLen > 0 )
+        serial.assign(szBuf, iLen);
+    }
+
+  return serial;
+}
+
+// Called with m_Mutex held.  Indexes the devices of uiVendorID and
+// uiProductID that are not yet, their serials are read without the mutex.
+// Returns once no other lookup is reading one of them either.
+void hid_device_registry::readSerials(const uint16_t uiVendorID,
+                                      const uint16_t uiProductID)
+{
+  libusb_wrapper &libusbWrapper = libusb_wrapper::getInstance();
+
+  while ( true )
+    {
+      std::vector<std::pair<libusb_device *, uint8_t> > pending;
+      bool bBusy = false;
+      for ( devices_t::iterator it = this->m_Devices.begin();
+            it != this->m_Devices.end(); ++it )
+        {
+          hid_registry_device_t &device = it->second;
+          if ( device.bIndexed ||
+               device.keys[0].uiVendorID != uiVendorID ||
+               device.keys[0].uiProductID != uiProductID )
+            continue;
+          if ( device.bReading )
+            bBusy = true;
+          else
+            {
+              device.bReading = true;
+              pending.push_back(std::make_pair(
+                libusbWrapper.libusbRefDevice(it->first),
+                device.uiSerialIndex));
+            }
+        }
+      if ( pending.empty() && !bBusy )
+        return;
+      if ( pending.empty() )
+        {
+          pthread_cond_wait(&this->m_SerialCondition, &this->m_Mutex);
+          continue;
+        }
+
+      std::vector<std::string> serials(pending.size());
+      pthread_mutex_unlock(&this->m_Mutex);
+      for ( size_t i = 0; i < pending.size(); i++ )
+        serials[i] = self_type_t::readSerial(pending[i].first,
+                                             pending[i].second);
+      pthread_mutex_lock(&this->m_Mutex);
+
+      // the device may have left meanwhile, or left and come back
+      for ( size_t i = 0; i < pending.size(); i++ )
+        {
+          devices_t::iterator it = this->m_Devices.find(pending[i].first);
+          if ( it != this->m_Devices.end() && it->second.bReading )
+            {
+              for ( size_t j = 0; j < it->second.keys.size(); j++ )
+                it->second.keys[j].serial = serials[i];
+              it->second.bReading = false;
+              this->indexDevice(it->second, it->first);
+            }
+          libusbWrapper.libusbUnrefDevice(pending[i].first);
+        }
+      pthread_cond_broadcast(&this->m_SerialCondition);
+    }
+}
+
+libusb_device *hid_device_registry::findDevice(const hid_device_info_t *pDevice)
+{
+  hid_registry_key_t key;
+  key.uiVendorID = pDevice->uiVendorID;
+  key.uiProductID = pDevice->uiProductID;
+  if ( pDevice->szSerial )
+    key.serial = pDevice->szSerial;
+  key.uiBusNumber = pDevice->uiBusNumber;
+  key.uiDeviceAddress = pDevice->uiDeviceAddress;
+  key.iInterfaceNumber = pDevice->iInterfaceNumber;
+
+  libusb_device *pResult = 0;
+  pthread_mutex_lock(&this->m_Mutex);
+  if ( this->m_bAttached )
+    {
+      this->update();
+      this->readSerials(key.uiVendorID, key.uiProductID);
+      interfaces_t::const_iterator it = this->m_Interfaces.find(key);
+      if ( it != this->m_Interfaces.end() )
+        pResult = libusb_wrapper::getInstance().libusbRefDevice(it->second);
+    }
+  pthread_mutex_unlock(&this->m_Mutex);
+
+  return pResult;
+}
+
+int hid_device_registry::findSerial(const uint16_t uiVendorID,
+                                    const uint16_t uiProductID,
+                                    std::string const& serial,
+                                    hid_device_info_t *pDevice)
+{
+  hid_registry_key_t key;
+  key.uiVendorID = uiVendorID;
+  key.uiProductID = uiProductID;
+  key.serial = serial;
+  key.uiBusNumber = 0;
+  key.uiDeviceAddress = 0;
+  key.iInterfaceNumber = 0;
+
+  int iResult = HID_LIBUSB_NO_DEVICE;
+  pthread_mutex_lock(&this->m_Mutex);
+  if ( this->m_bAttached )
+    {
+      this->update();
+      this->readSerials(uiVendorID, uiProductID);
+      serials_t::const_iterator it = this->m_Serials.find(key);
+      if ( it != this->m_Serials.end() )
+        {
+          std::vector<hid_registry_key_t> const& matches = it->second;
+          const hid_registry_key_t *pFirst = &matches[0];
+          for ( size_t i = 1; i < matches.size(); i++ )
+            if ( matches[i].iInterfaceNumber < pFirst->iInterfaceNumber )
+              pFirst = &matches[i];
+
+          pDevice->uiVendorID = pFirst->uiVendorID;
+          pDevice->uiProductID = pFirst->uiProductID;
+          pDevice->szSerial = 0;
+          pDevice->uiReleaseNumber = 0;
+          pDevice->szManufacturer = 0;
+          pDevice->szProduct = 0;
+          pDevice->iInterfaceNumber = pFirst->iInterfaceNumber;
+          pDevice->uiBusNumber = pFirst->uiBusNumber;
+          pDevice->uiDeviceAddress = pFirst->uiDeviceAddress;
+          pDevice->pNext = 0;
+          iResult = 0;
+        }
+    }
+  pthread_mutex_unlock(&this->m_Mutex);
+
+  return iResult;
+}
+
+size_t hid_device_registry::size()
+{
+  pthread_mutex_lock(&this->m_Mutex);
+  size_t uiSize = 0;
+  if ( this->m_bAttached )
+    this->update();
+  // read or not, every interface counts
+  for ( devices_t::const_iterator it = this->m_Devices.begin();
+        it != this->m_Devices.end(); ++it )
+    uiSize += it->second.keys.size();
+  pthread_mutex_unlock(&this->m_Mutex);
+
+  return uiSize;
+}
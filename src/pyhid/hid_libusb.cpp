@@ -38,6 +38,7 @@
 // 0.1       | hartmann   | 19 Jun 2013   |  initial version
 // ----------------------------------------------------------------
 #include "pyhid/hid_libusb.hpp"
+#include "pyhid/device_registry.hpp"
 
 #include <libudev.h>
 #include <stdio.h>
@@ -46,9 +47,26 @@
 #include <time.h>
 #include <errno.h>
 #include <dlfcn.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <stdexcept>
 
 libusb_context *hid_libusb::m_pContext = 0;
+pthread_mutex_t hid_libusb::m_EventLoopMutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_t hid_libusb::m_EventThread;
+unsigned int hid_libusb::m_uiEventLoopUsers = 0;
+std::atomic<bool> hid_libusb::m_bStopEventLoop(false);
+// recursive, setReportCallback() starts and stops under it, never held
+// while a report callback runs
+pthread_mutex_t hid_libusb::m_DispatchMutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+pthread_cond_t hid_libusb::m_DispatchCondition = PTHREAD_COND_INITIALIZER;
+// the device whose callback runs on this thread, set on dispatchers only
+thread_local hid_libusb *hid_libusb::m_pDispatching = 0;
+hid_libusb::dispatcher_t *hid_libusb::m_pDispatcher = 0;
+unsigned int hid_libusb::m_uiReportCallbacks = 0;
+std::set<hid_libusb *> hid_libusb::m_Dispatched;
 
 const char *libusb_wrapper::usbi_errors[] =
   {
@@ -88,13 +106,20 @@ libusb_wrapper::libusb_wrapper() : m_pLib(0),
                                    libusbReleaseInterface(0),
                                    libusbGetStringDescriptorAscii(0),
                                    libusbHandleEvents(0),
+                                   libusbHandleEventsTimeout(0),
+                                   libusbInterruptEventHandler(0),
                                    libusbAllocTransfer(0),
                                    libusbFreeTransfer(0),
                                    libusbSubmitTransfer(0),
                                    libusbCancelTransfer(0),
                                    libusbControlTransfer(0),
                                    libusbInterruptTransfer(0),
-                                   libusbStrerror(0)
+                                   libusbStrerror(0),
+                                   libusbHasCapability(0),
+                                   libusbRefDevice(0),
+                                   libusbUnrefDevice(0),
+                                   libusbHotplugRegisterCallback(0),
+                                   libusbHotplugDeregisterCallback(0)
 {
 }
 
@@ -163,6 +188,10 @@ bool libusb_wrapper::loadUSBLib()
     ::dlsym(this->m_pLib, "libusb_get_string_descriptor_ascii");
   this->libusbHandleEvents              = (libusbHandleEvents_t)
     ::dlsym(this->m_pLib, "libusb_handle_events");
+  this->libusbHandleEventsTimeout       = (libusbHandleEventsTimeout_t)
+    ::dlsym(this->m_pLib, "libusb_handle_events_timeout");
+  this->libusbInterruptEventHandler     = (libusbInterruptEventHandler_t)
+    ::dlsym(this->m_pLib, "libusb_interrupt_event_handler");
   this->libusbAllocTransfer             = (libusbAllocTransfer_t)
     ::dlsym(this->m_pLib, "libusb_alloc_transfer");
   this->libusbFreeTransfer              = (libusbFreeTransfer_t)
@@ -177,6 +206,16 @@ bool libusb_wrapper::loadUSBLib()
     ::dlsym(this->m_pLib, "libusb_interrupt_transfer");
   this->libusbStrerror                  = (libusbStrerror_t)
     ::dlsym(this->m_pLib, "libusb_strerror");
+  this->libusbHasCapability             = (libusbHasCapability_t)
+    ::dlsym(this->m_pLib, "libusb_has_capability");
+  this->libusbRefDevice                 = (libusbRefDevice_t)
+    ::dlsym(this->m_pLib, "libusb_ref_device");
+  this->libusbUnrefDevice               = (libusbUnrefDevice_t)
+    ::dlsym(this->m_pLib, "libusb_unref_device");
+  this->libusbHotplugRegisterCallback   = (libusbHotplugRegisterCallback_t)
+    ::dlsym(this->m_pLib, "libusb_hotplug_register_callback");
+  this->libusbHotplugDeregisterCallback = (libusbHotplugDeregisterCallback_t)
+    ::dlsym(this->m_pLib, "libusb_hotplug_deregister_callback");
 
   if ( ! this->libusbStrerror )
     this->libusbStrerror = libusb_wrapper::libusb_strerror;
@@ -197,7 +236,9 @@ bool libusb_wrapper::loadUSBLib()
                         this->libusbClaimInterface &&
                         this->libusbReleaseInterface &&
                         this->libusbGetStringDescriptorAscii &&
-                        this->libusbHandleEvents && this->libusbAllocTransfer &&
+                        this->libusbHandleEvents &&
+                        this->libusbHandleEventsTimeout &&
+                        this->libusbAllocTransfer &&
                         this->libusbFreeTransfer &&
                         this->libusbSubmitTransfer &&
                         this->libusbCancelTransfer &&
@@ -235,6 +276,8 @@ void libusb_wrapper::closeUSBLib()
   this->libusbReleaseInterface          = 0;
   this->libusbGetStringDescriptorAscii  = 0;
   this->libusbHandleEvents              = 0;
+  this->libusbHandleEventsTimeout       = 0;
+  this->libusbInterruptEventHandler     = 0;
   this->libusbAllocTransfer             = 0;
   this->libusbFreeTransfer              = 0;
   this->libusbSubmitTransfer            = 0;
@@ -242,6 +285,11 @@ void libusb_wrapper::closeUSBLib()
   this->libusbControlTransfer           = 0;
   this->libusbInterruptTransfer         = 0;
   this->libusbStrerror                  = 0;
+  this->libusbHasCapability             = 0;
+  this->libusbRefDevice                 = 0;
+  this->libusbUnrefDevice               = 0;
+  this->libusbHotplugRegisterCallback   = 0;
+  this->libusbHotplugDeregisterCallback = 0;
 }
 
 libusb_wrapper::~libusb_wrapper()
@@ -250,8 +298,11 @@ libusb_wrapper::~libusb_wrapper()
 }
 
 hid_libusb::hid_libusb() : m_pDeviceHandle(0),
-                           m_pInputReports(0),
+                           m_InputReports(),
                            m_bShutdownThread(false),
+                           m_iActiveTransfers(0),
+                           m_iActiveWrites(0),
+                           m_iStartResult(0),
                            m_uiMaxPacketSize(0),
                            m_iInputEndpoint(0),
                            m_iOutputEndpoint(0),
@@ -265,16 +316,69 @@ hid_libusb::hid_libusb() : m_pDeviceHandle(0),
                            m_szDevAddr(),
                            m_pDevices(0),
                            m_pUdev(udev_new()),
-                           m_pTransfer(0)
+                           m_ppTransfers(0),
+                           m_puiTransferBuffers(0),
+                           m_uiTransferDepth(HID_LIBUSB_DEFAULT_TRANSFER_DEPTH),
+                           m_ppParkedTransfers(0),
+                           m_iParkedTransfers(0),
+                           m_iResumingReaders(0),
+                           m_uiQueueCapacity(HID_LIBUSB_DEFAULT_QUEUE_SIZE),
+                           m_eOverflowPolicy(HID_OVERFLOW_DROP_OLDEST),
+                           m_iTimestampClock(CLOCK_MONOTONIC),
+                           m_bDedicatedThread(false),
+                           m_bUseDedicatedThread(false),
+                           m_WriteQueue(),
+                           m_pNextWrite(0),
+                           m_pOutputTransfers(0),
+                           m_pIdleWrites(0),
+                           m_uiOutputDepth(HID_LIBUSB_DEFAULT_OUTPUT_DEPTH),
+                           m_bDrainingWrites(false),
+                           m_bWritesPending(false),
+                           m_pTransactions(0),
+                           m_uiTransactionWindow(
+                             HID_LIBUSB_DEFAULT_TRANSACTION_WINDOW),
+                           m_iPendingTransactions(0),
+                           m_uiTransactionSequence(0),
+                           m_pInputFilter(0),
+                           m_pRetiredFilters(0),
+                           m_uiFilterEpoch(0),
+                           m_uiFilteredReports(0),
+                           m_pReportCallback(0),
+                           m_pReportCallbackData(0),
+                           m_uiCallbackBatch(HID_LIBUSB_DEFAULT_CALLBACK_BATCH),
+                           m_uiDispatchRefs(0),
+                           m_pCapture(0),
+                           m_iCaptureDevice(-1),
+                           m_pTransport(0)
 {
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&this->m_TransactionCondition, &attr);
+  pthread_condattr_destroy(&attr);
+  pthread_mutex_init(&this->m_TransactionMutex, 0);
+  pthread_mutex_init(&this->m_FilterMutex, 0);
+
+  for ( int i = 0; i < 256; i++ )
+    {
+      this->m_apReportQueues[i] = 0;
+      this->m_abReportQueues[i] = false;
+    }
 }
 
 hid_libusb::~hid_libusb()
 {
+  // also when closed already, the device may be deleted by its callback
+  this->setReportCallback(0);
   this->closeHID();
   this->freeHIDEnumeration();
   if ( this->m_pUdev )
     udev_unref(this->m_pUdev);
+  pthread_cond_destroy(&this->m_TransactionCondition);
+  pthread_mutex_destroy(&this->m_TransactionMutex);
+  this->retireFilters();
+  delete this->m_pInputFilter.load();
+  pthread_mutex_destroy(&this->m_FilterMutex);
 }
 
 char *hid_libusb::getUSBString(libusb_device_handle *pDevHandle,
@@ -354,20 +458,64 @@ bool hid_libusb::findUdevPath()
   return true;
 }
 
-int hid_libusb::returnData(uint8_t *puiData, size_t uiLength)
+static bool acceptReport(const hid_input_filter_t *pFilter,
+                         const uint8_t *puiData, size_t uiLength)
 {
-  input_report_t *pReport = this->m_pInputReports;
-  size_t uiLen = ( uiLength < pReport->uiLength ) ?
-    uiLength : pReport->uiLength;
+  for ( size_t i = 0; i < pFilter->drops.size(); i++ )
+    if ( pFilter->drops[i].matches(puiData, uiLength) )
+      return false;
+
+  return !pFilter->pPredicate ||
+    pFilter->pPredicate(puiData, uiLength, pFilter->pUserData);
+}
 
-  if ( uiLen > 0 && puiData )
-    memcpy(puiData, pReport->puiData, uiLen);
-  this->m_pInputReports = pReport->pNext;
+void hid_libusb::processInputReport(const uint8_t *puiData, size_t uiLength)
+{
+  uint64_t uiTimestamp = 0;
+  bool bStamped = false;
+  if ( this->m_iCaptureDevice >= 0 )
+    {
+      // everything the device sent, filtered or not
+      uiTimestamp = self_type_t::getCaptureTimestamp();
+      bStamped = this->m_iTimestampClock.load(std::memory_order_relaxed) ==
+        CLOCK_MONOTONIC;
+      this->m_pCapture->record(this->m_iCaptureDevice, HID_CAPTURE_INPUT,
+                               uiTimestamp, puiData, uiLength);
+    }
 
-  delete [] pReport->puiData;
-  delete pReport;
+  // The epoch is odd while the filter set is in use.  Sequentially
+  // consistent, so that publishFilter() either sees us inside or we
+  // load the set it published.
+  this->m_uiFilterEpoch.fetch_add(1);
+  const hid_input_filter_t *pFilter = this->m_pInputFilter.load();
+  const bool bAccept = !pFilter || acceptReport(pFilter, puiData, uiLength);
+  this->m_uiFilterEpoch.fetch_add(1);
 
-  return uiLen;
+  if ( !bAccept )
+    {
+      // rejected before anything was queued
+      this->m_uiFilteredReports.fetch_add(1, std::memory_order_relaxed);
+      if ( this->m_eOverflowPolicy == HID_OVERFLOW_BLOCK )
+        this->m_InputReports.release();
+      return;
+    }
+
+  if ( !bStamped )
+    uiTimestamp = this->getTimestamp();
+
+  hid_report_queue *pQueue = 0;
+  if ( this->m_iPendingTransactions > 0 &&
+       this->matchTransaction(puiData, uiLength, uiTimestamp) )
+    {
+      // the reply went to its transaction, hand back the queue slot
+      // reserved for it
+      if ( this->m_eOverflowPolicy == HID_OVERFLOW_BLOCK )
+        this->m_InputReports.release();
+    }
+  else if ( uiLength > 0 && ( pQueue = this->m_apReportQueues[puiData[0]] ) )
+    pQueue->push(puiData, uiLength, uiTimestamp);
+  else
+    this->m_InputReports.push(puiData, uiLength, uiTimestamp);
 }
 
 void hid_libusb::readCallback(struct libusb_transfer *pTransfer)
@@ -375,100 +523,521 @@ void hid_libusb::readCallback(struct libusb_transfer *pTransfer)
   self_type_t *pThis = static_cast<self_type_t *>(pTransfer->user_data);
 
   if ( pTransfer->status == LIBUSB_TRANSFER_COMPLETED )
+    pThis->processInputReport(pTransfer->buffer, pTransfer->actual_length);
+  else if ( pTransfer->status == LIBUSB_TRANSFER_CANCELLED ||
+            pTransfer->status == LIBUSB_TRANSFER_NO_DEVICE )
     {
-      input_report_t *pReport = new input_report_t;
-      pReport->puiData = new uint8_t[pTransfer->actual_length];
-      memcpy(pReport->puiData, pTransfer->buffer, pTransfer->actual_length);
-      pReport->uiLength = pTransfer->actual_length;
-      pReport->pNext = 0;
+      pThis->m_bShutdownThread = true;
+      pThis->retireTransfer();
+      return;
+    }
+  else if ( pThis->m_eOverflowPolicy == HID_OVERFLOW_BLOCK )
+    pThis->m_InputReports.release();
 
-      pthread_mutex_lock(&pThis->m_Mutex);
+  if ( pThis->m_bShutdownThread )
+    {
+      pThis->retireTransfer();
+      return;
+    }
+
+  pThis->submitTransfer(pTransfer);
+}
 
-      if ( !pThis->m_pInputReports )
+uint64_t hid_libusb::getTimestamp() const
+{
+  struct timespec ts;
+  clock_gettime(this->m_iTimestampClock.load(std::memory_order_relaxed), &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Captures stay in CLOCK_MONOTONIC whatever clock the devices stamp their
+// reports with, the records of all devices are indexed by one time line.
+uint64_t hid_libusb::getCaptureTimestamp()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void hid_libusb::submitTransfer(struct libusb_transfer *pTransfer)
+{
+  // With lossless backpressure every submitted transfer owns a free queue
+  // slot.  Without one the transfer is parked until the reader made room,
+  // so the device has to hold on to its reports.
+  if ( this->m_eOverflowPolicy == HID_OVERFLOW_BLOCK &&
+       !this->m_InputReports.reserve() )
+    {
+      pthread_mutex_lock(&this->m_TransferMutex);
+      this->m_ppParkedTransfers[this->m_iParkedTransfers] = pTransfer;
+      this->m_iParkedTransfers++;
+      pthread_mutex_unlock(&this->m_TransferMutex);
+      this->retireTransfer();
+
+      // the reader may have freed a slot before the transfer was parked
+      this->resumeTransfers();
+      return;
+    }
+
+  if ( this->m_pTransport->submitTransfer(pTransfer) )
+    {
+      this->m_bShutdownThread = true;
+      this->retireTransfer();
+    }
+}
+
+void hid_libusb::resumeTransfers()
+{
+  // closeHID() frees the transfer state once nobody is in here, readers
+  // that come after the shutdown keep out
+  this->m_iResumingReaders++;
+  if ( this->m_bShutdownThread )
+    {
+      this->m_iResumingReaders--;
+      return;
+    }
+
+  pthread_mutex_lock(&this->m_TransferMutex);
+  if ( this->m_bShutdownThread )
+    {
+      pthread_mutex_unlock(&this->m_TransferMutex);
+      this->m_iResumingReaders--;
+      return;
+    }
+  while ( this->m_iParkedTransfers > 0 )
+    {
+      this->m_iActiveTransfers++;
+      if ( this->m_bShutdownThread || !this->m_InputReports.reserve() )
         {
-          pThis->m_pInputReports = pReport;
-          pthread_cond_signal(&pThis->m_Condition);
+          this->m_iActiveTransfers--;
+          break;
         }
-      else
+
+      this->m_iParkedTransfers--;
+      struct libusb_transfer *pTransfer =
+        this->m_ppParkedTransfers[this->m_iParkedTransfers];
+      if ( this->m_pTransport->submitTransfer(pTransfer) )
         {
-          input_report_t *pCurrent = pThis->m_pInputReports;
-          int iNumQueued = 0;
-          while ( pCurrent->pNext )
-            {
-              pCurrent = pCurrent->pNext;
-              iNumQueued++;
-            }
-          pCurrent->pNext = pReport;
-          if ( iNumQueued > 30 )
-            pThis->returnData(0, 0);
+          this->m_bShutdownThread = true;
+          this->m_iActiveTransfers--;
         }
-      pthread_mutex_unlock(&pThis->m_Mutex);
     }
-  else if ( pTransfer->status == LIBUSB_TRANSFER_CANCELLED ||
-            pTransfer->status == LIBUSB_TRANSFER_NO_DEVICE )
+  pthread_mutex_unlock(&this->m_TransferMutex);
+  this->m_iResumingReaders--;
+}
+
+void hid_libusb::retireTransfer()
+{
+  if ( --this->m_iActiveTransfers > 0 || !this->m_bShutdownThread )
+    return;
+
+  this->shutdownQueues();
+  this->notifyRetired();
+}
+
+void hid_libusb::notifyRetired()
+{
+  pthread_mutex_lock(&this->m_TransferMutex);
+  pthread_cond_broadcast(&this->m_TransferCondition);
+  pthread_mutex_unlock(&this->m_TransferMutex);
+}
+
+int hid_libusb::startTransfers()
+{
+  const size_t uiLength = this->m_uiMaxPacketSize;
+  const size_t uiDepth = this->m_uiTransferDepth;
+
+  // Keep several transfers queued on the endpoint, so the host controller
+  // always has one pending while a completion is being processed.
+  this->m_puiTransferBuffers = new uint8_t[uiDepth * uiLength];
+  this->m_ppTransfers = new struct libusb_transfer *[uiDepth];
+  this->m_ppParkedTransfers = new struct libusb_transfer *[uiDepth];
+  for ( size_t i = 0; i < uiDepth; i++ )
     {
-      pThis->m_bShutdownThread = true;
-      return;
+      this->m_ppTransfers[i] = this->m_pTransport->allocTransfer();
+      if ( !this->m_ppTransfers[i] )
+        {
+          // nothing is submitted yet
+          for ( size_t j = 0; j < i; j++ )
+            this->m_pTransport->freeTransfer(this->m_ppTransfers[j]);
+          delete [] this->m_ppTransfers;
+          delete [] this->m_ppParkedTransfers;
+          delete [] this->m_puiTransferBuffers;
+          this->m_ppTransfers = 0;
+          this->m_ppParkedTransfers = 0;
+          this->m_puiTransferBuffers = 0;
+          return LIBUSB_ERROR_NO_MEM;
+        }
     }
 
-  int iResult = libusb_wrapper::getInstance().libusbSubmitTransfer(pTransfer);
-  if ( iResult )
-    pThis->m_bShutdownThread = true;
+  this->m_iActiveTransfers = 0;
+  this->m_iParkedTransfers = 0;
+  for ( size_t i = 0; i < uiDepth; i++ )
+    {
+      libusb_fill_interrupt_transfer(this->m_ppTransfers[i],
+                                     this->m_pDeviceHandle,
+                                     this->m_iInputEndpoint,
+                                     this->m_puiTransferBuffers + i * uiLength,
+                                     uiLength,
+                                     self_type_t::readCallback,
+                                     this,
+                                     5000
+                                     );
+
+      this->m_iActiveTransfers++;
+      this->submitTransfer(this->m_ppTransfers[i]);
+    }
+
+  return 0;
+}
+
+void hid_libusb::waitTransfers()
+{
+  // outstanding writes are not cancelled, they end within their timeout
+  pthread_mutex_lock(&this->m_TransferMutex);
+  while ( this->m_iActiveTransfers > 0 || this->m_iActiveWrites > 0 )
+    pthread_cond_wait(&this->m_TransferCondition, &this->m_TransferMutex);
+  pthread_mutex_unlock(&this->m_TransferMutex);
 }
 
 void *hid_libusb::readThread(void *pParam)
 {
   self_type_t *pThis = static_cast<self_type_t *>(pParam);
-  uint8_t *puiBuf;
-  const size_t uiLength = pThis->m_uiMaxPacketSize;
-
-  libusb_wrapper &libusbWrapper = libusb_wrapper::getInstance();
-
-  puiBuf = new uint8_t[uiLength];
-  pThis->m_pTransfer = libusbWrapper.libusbAllocTransfer(0);
-  libusb_fill_interrupt_transfer(pThis->m_pTransfer,
-                                 pThis->m_pDeviceHandle,
-                                 pThis->m_iInputEndpoint,
-                                 puiBuf,
-                                 uiLength,
-                                 self_type_t::readCallback,
-                                 pThis,
-                                 5000
-                                 );
 
-  libusbWrapper.libusbSubmitTransfer(pThis->m_pTransfer);
+  pThis->m_iStartResult = pThis->startTransfers();
 
   pthread_barrier_wait(&pThis->m_Barrier);
+  if ( pThis->m_iStartResult < 0 )
+    return 0;
 
-  while ( ! pThis->m_bShutdownThread )
+  // keep handling events until every transfer has been retired, the
+  // cancellations have to be reaped by someone
+  bool bCancelled = false;
+  while ( ! pThis->m_bShutdownThread || pThis->m_iActiveTransfers > 0 ||
+          pThis->m_iActiveWrites > 0 )
     {
-      int iResult = libusbWrapper.libusbHandleEvents(self_type_t::m_pContext);
+      if ( pThis->m_bShutdownThread && !bCancelled )
+        {
+          pThis->cancelTransfers();
+          bCancelled = true;
+        }
+
+      struct timeval tv;
+      tv.tv_sec = 0;
+      tv.tv_usec = HID_LIBUSB_EVENT_TIMEOUT_MS * 1000;
+      int iResult = pThis->m_pTransport->handleEvents(&tv);
       if ( iResult < 0 )
         {
           if ( iResult != LIBUSB_ERROR_BUSY &&
                iResult != LIBUSB_ERROR_TIMEOUT &&
                iResult != LIBUSB_ERROR_OVERFLOW &&
                iResult != LIBUSB_ERROR_INTERRUPTED )
-            break;
+            pThis->m_bShutdownThread = true;
         }
     }
 
-  if ( ! libusbWrapper.libusbCancelTransfer(pThis->m_pTransfer) )
-    libusbWrapper.libusbHandleEvents(self_type_t::m_pContext);
+  return 0;
+}
 
-  pthread_mutex_lock(&pThis->m_Mutex);
-  pthread_cond_broadcast(&pThis->m_Condition);
-  pthread_mutex_unlock(&pThis->m_Mutex);
+void *hid_libusb::eventThread(void *)
+{
+  libusb_wrapper &libusbWrapper = libusb_wrapper::getInstance();
 
-  delete [] puiBuf;
+  while ( ! self_type_t::m_bStopEventLoop )
+    {
+      struct timeval tv;
+      tv.tv_sec = 0;
+      tv.tv_usec = HID_LIBUSB_EVENT_TIMEOUT_MS * 1000;
+      libusbWrapper.libusbHandleEventsTimeout(self_type_t::m_pContext, &tv);
+    }
 
   return 0;
 }
 
-void hid_libusb::cleanupMutex(void *pParam)
+int hid_libusb::acquireEventLoop()
 {
-  self_type_t *pThis = static_cast<self_type_t *>(pParam);
-  pthread_mutex_unlock(&pThis->m_Mutex);
+  int iResult = 0;
+
+  pthread_mutex_lock(&self_type_t::m_EventLoopMutex);
+  if ( !self_type_t::m_uiEventLoopUsers )
+    {
+      self_type_t::m_bStopEventLoop = false;
+      iResult = pthread_create(&self_type_t::m_EventThread, 0,
+                               self_type_t::eventThread, 0);
+    }
+  if ( !iResult )
+    self_type_t::m_uiEventLoopUsers++;
+  pthread_mutex_unlock(&self_type_t::m_EventLoopMutex);
+
+  return iResult ? LIBUSB_ERROR_OTHER : 0;
+}
+
+void hid_libusb::releaseEventLoop()
+{
+  pthread_mutex_lock(&self_type_t::m_EventLoopMutex);
+  if ( self_type_t::m_uiEventLoopUsers && !--self_type_t::m_uiEventLoopUsers )
+    {
+      libusb_wrapper &libusbWrapper = libusb_wrapper::getInstance();
+
+      self_type_t::m_bStopEventLoop = true;
+      if ( libusbWrapper.libusbInterruptEventHandler )
+        libusbWrapper.libusbInterruptEventHandler(self_type_t::m_pContext);
+      pthread_join(self_type_t::m_EventThread, 0);
+    }
+  pthread_mutex_unlock(&self_type_t::m_EventLoopMutex);
+}
+
+void *hid_libusb::dispatchThread(void *pParam)
+{
+  dispatcher_t *pDispatcher = static_cast<dispatcher_t *>(pParam);
+  struct epoll_event aEvents[16];
+
+  pthread_mutex_lock(&self_type_t::m_DispatchMutex);
+  while ( self_type_t::m_pDispatcher == pDispatcher )
+    {
+      pthread_mutex_unlock(&self_type_t::m_DispatchMutex);
+      const int iEvents = epoll_wait(pDispatcher->iEpoll, aEvents, 16, -1);
+      pthread_mutex_lock(&self_type_t::m_DispatchMutex);
+
+      // stopped from within a callback, a new dispatcher may have taken
+      // over the devices already
+      for ( int i = 0;
+            i < iEvents && self_type_t::m_pDispatcher == pDispatcher; i++ )
+        {
+          // the wake-up eventfd, or a device stopped after epoll_wait()
+          // returned
+          hid_libusb *pDevice = static_cast<hid_libusb *>(aEvents[i].data.ptr);
+          if ( !self_type_t::m_Dispatched.count(pDevice) )
+            continue;
+
+          // The callback runs without the mutex, pinned by the reference
+          // stopDispatch() waits for.  It sees the registration of the
+          // moment it was pinned.
+          const hid_report_callback_t pCallback = pDevice->m_pReportCallback;
+          void *pUserData = pDevice->m_pReportCallbackData;
+          const size_t uiMaxReports = pDevice->m_uiCallbackBatch;
+          pDevice->m_uiDispatchRefs++;
+          self_type_t::m_pDispatching = pDevice;
+          pthread_mutex_unlock(&self_type_t::m_DispatchMutex);
+
+          pDevice->dispatchReports(pCallback, pUserData, uiMaxReports);
+
+          pthread_mutex_lock(&self_type_t::m_DispatchMutex);
+          // unpinned already if the callback stopped, closed or deleted
+          // its own device
+          if ( self_type_t::m_pDispatching == pDevice )
+            {
+              pDevice->m_uiDispatchRefs--;
+              pthread_cond_broadcast(&self_type_t::m_DispatchCondition);
+            }
+          self_type_t::m_pDispatching = 0;
+        }
+    }
+  pthread_mutex_unlock(&self_type_t::m_DispatchMutex);
+
+  close(pDispatcher->iWake);
+  close(pDispatcher->iEpoll);
+  delete pDispatcher;
+
+  return 0;
+}
+
+// Called with m_DispatchMutex held, ends the dispatcher once the last
+// report callback is gone.  True if the caller has to join *pThread
+// after releasing the mutex.
+bool hid_libusb::stopDispatcher(pthread_t *pThread)
+{
+  dispatcher_t *pDispatcher = self_type_t::m_pDispatcher;
+  if ( !pDispatcher || self_type_t::m_uiReportCallbacks )
+    return false;
+
+  self_type_t::m_pDispatcher = 0;
+  eventfd_write(pDispatcher->iWake, 1);
+  if ( pthread_equal(pthread_self(), pDispatcher->thread) )
+    {
+      // a callback cannot join the thread it runs on, it ends on its own
+      pthread_detach(pDispatcher->thread);
+      return false;
+    }
+  *pThread = pDispatcher->thread;
+
+  return true;
+}
+
+int hid_libusb::startDispatch()
+{
+  const int iFd = this->m_InputReports.eventFD();
+  if ( iFd < 0 )
+    return iFd;
+
+  int iResult = 0;
+  pthread_mutex_lock(&self_type_t::m_DispatchMutex);
+  if ( !self_type_t::m_pDispatcher )
+    {
+      // Started with the first callback that has reports to dispatch,
+      // stopDispatcher() ends it with the last one.
+      dispatcher_t *pDispatcher = new dispatcher_t;
+      struct epoll_event event;
+      event.events = EPOLLIN;
+      event.data.ptr = 0;
+      pDispatcher->iEpoll = epoll_create1(EPOLL_CLOEXEC);
+      pDispatcher->iWake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      if ( pDispatcher->iEpoll >= 0 && pDispatcher->iWake >= 0 &&
+           !epoll_ctl(pDispatcher->iEpoll, EPOLL_CTL_ADD, pDispatcher->iWake,
+                      &event) &&
+           !pthread_create(&pDispatcher->thread, 0,
+                           self_type_t::dispatchThread, pDispatcher) )
+        self_type_t::m_pDispatcher = pDispatcher;
+      else
+        {
+          if ( pDispatcher->iWake >= 0 )
+            close(pDispatcher->iWake);
+          if ( pDispatcher->iEpoll >= 0 )
+            close(pDispatcher->iEpoll);
+          delete pDispatcher;
+          iResult = LIBUSB_ERROR_OTHER;
+        }
+    }
+  if ( !iResult && !self_type_t::m_Dispatched.count(this) )
+    {
+      struct epoll_event event;
+      event.events = EPOLLIN;
+      event.data.ptr = this;
+      if ( epoll_ctl(self_type_t::m_pDispatcher->iEpoll, EPOLL_CTL_ADD, iFd,
+                     &event) < 0 )
+        iResult = LIBUSB_ERROR_OTHER;
+      else
+        self_type_t::m_Dispatched.insert(this);
+    }
+  pthread_mutex_unlock(&self_type_t::m_DispatchMutex);
+
+  return iResult;
+}
+
+void hid_libusb::stopDispatch()
+{
+  pthread_mutex_lock(&self_type_t::m_DispatchMutex);
+  if ( self_type_t::m_Dispatched.erase(this) )
+    {
+      struct epoll_event event;
+      epoll_ctl(self_type_t::m_pDispatcher->iEpoll, EPOLL_CTL_DEL,
+                this->m_InputReports.eventFD(), &event);
+    }
+  this->waitDispatch();
+  pthread_mutex_unlock(&self_type_t::m_DispatchMutex);
+}
+
+// called with m_DispatchMutex held once
+void hid_libusb::waitDispatch()
+{
+  if ( self_type_t::m_pDispatching == this )
+    {
+      // from within its own callback, the dispatcher leaves the device
+      // alone from now on
+      this->m_uiDispatchRefs--;
+      self_type_t::m_pDispatching = 0;
+    }
+  // a callback running on the dispatcher thread
+  while ( this->m_uiDispatchRefs )
+    pthread_cond_wait(&self_type_t::m_DispatchCondition,
+                      &self_type_t::m_DispatchMutex);
+}
+
+void hid_libusb::restartDispatch()
+{
+  if ( !this->m_pReportCallback )
+    return;
+
+  pthread_t thread;
+  pthread_mutex_lock(&self_type_t::m_DispatchMutex);
+  if ( this->m_pReportCallback && this->startDispatch() < 0 )
+    this->storeReportCallback(0, this->m_pReportCallbackData,
+                              this->m_uiCallbackBatch);
+  const bool bJoin = self_type_t::stopDispatcher(&thread);
+  pthread_mutex_unlock(&self_type_t::m_DispatchMutex);
+  if ( bJoin )
+    pthread_join(thread, 0);
+}
+
+// called with m_DispatchMutex held
+void hid_libusb::storeReportCallback(hid_report_callback_t pCallback,
+                                     void *pUserData,
+                                     const size_t uiMaxReports)
+{
+  if ( pCallback && !this->m_pReportCallback )
+    self_type_t::m_uiReportCallbacks++;
+  else if ( !pCallback && this->m_pReportCallback )
+    self_type_t::m_uiReportCallbacks--;
+  this->m_pReportCallback = pCallback;
+  this->m_pReportCallbackData = pUserData;
+  this->m_uiCallbackBatch = uiMaxReports;
+}
+
+void hid_libusb::dispatchReports(hid_report_callback_t pCallback,
+                                 void *pUserData, const size_t uiMaxReports)
+{
+  // One batch per wakeup, the eventfd stays readable while reports are
+  // left, so busy devices cannot starve the others.
+  const int iResult = this->readBatch(this->m_DispatchBatch, uiMaxReports, 0);
+  if ( iResult < 0 )
+    this->stopDispatch();
+  else if ( iResult > 0 && pCallback )
+    pCallback(this->m_DispatchBatch, pUserData);
+  // the callback may have closed or deleted the device
+}
+
+int hid_libusb::setReportCallback(hid_report_callback_t pCallback,
+                                  void *pUserData,
+                                  const size_t uiMaxReports)
+{
+  if ( pCallback && !uiMaxReports )
+    return HID_LIBUSB_INVALID_ARGS;
+
+  int iResult = 0;
+  pthread_t thread;
+  pthread_mutex_lock(&self_type_t::m_DispatchMutex);
+  // the user data of a running callback stays valid until it returns
+  this->waitDispatch();
+  this->storeReportCallback(pCallback, pUserData, uiMaxReports);
+  if ( !pCallback )
+    this->stopDispatch();
+  else if ( this->m_bOpenDevice )
+    {
+      iResult = this->startDispatch();
+      if ( iResult < 0 )
+        this->storeReportCallback(0, pUserData, uiMaxReports);
+    }
+  const bool bJoin = self_type_t::stopDispatcher(&thread);
+  pthread_mutex_unlock(&self_type_t::m_DispatchMutex);
+  if ( bJoin )
+    pthread_join(thread, 0);
+
+  return iResult;
+}
+
+void hid_libusb::cancelTransfers()
+{
+  if ( !this->m_ppTransfers )
+    return;
+
+  for ( size_t i = 0; i < this->m_uiTransferDepth; i++ )
+    this->m_pTransport->cancelTransfer(this->m_ppTransfers[i]);
+}
+
+void hid_libusb::freeTransfers()
+{
+  if ( !this->m_ppTransfers )
+    return;
+
+  for ( size_t i = 0; i < this->m_uiTransferDepth; i++ )
+    this->m_pTransport->freeTransfer(this->m_ppTransfers[i]);
+
+  delete [] this->m_ppTransfers;
+  delete [] this->m_ppParkedTransfers;
+  delete [] this->m_puiTransferBuffers;
+  this->m_ppTransfers = 0;
+  this->m_ppParkedTransfers = 0;
+  this->m_puiTransferBuffers = 0;
+  this->m_iParkedTransfers = 0;
 }
 
 int hid_libusb::enumerateHID(const uint16_t uiVendorID,
@@ -477,15 +1046,9 @@ int hid_libusb::enumerateHID(const uint16_t uiVendorID,
   libusb_device **ppList;
   libusb_wrapper &libusbWrapper = libusb_wrapper::getInstance();
 
-  if ( ! self_type_t::m_pContext )
-    {
-      if ( !libusbWrapper.loadUSBLib() )
-        return HID_LIBUSB_NO_LIBUSB;
-      const int iResult = libusbWrapper.libusbInit(&self_type_t::m_pContext);
-      if ( iResult )
-        return iResult;
-      atexit(self_type_t::freeHID);
-    }
+  const int iInit = self_type_t::initContext();
+  if ( iInit < 0 )
+    return iInit;
 
   ssize_t iDeviceCount = libusbWrapper.libusbGetDeviceList(
                             self_type_t::m_pContext, &ppList);
@@ -602,128 +1165,755 @@ void hid_libusb::freeHIDEnumeration()
   this->m_pDevices = 0;
 }
 
+typedef struct group_write
+{
+  pthread_mutex_t mutex;
+  pthread_cond_t  condition;
+  size_t          uiPending;
+  int            *piResults;
+} group_write_t;
+
+typedef struct group_member
+{
+  group_write_t  *pGroup;
+  size_t          uiIndex;
+} group_member_t;
+
+static void groupWriteCallback(int iResult, void *pUserData)
+{
+  group_member_t *pMember = static_cast<group_member_t *>(pUserData);
+  group_write_t *pGroup = pMember->pGroup;
+
+  pthread_mutex_lock(&pGroup->mutex);
+  pGroup->piResults[pMember->uiIndex] = iResult;
+  if ( !--pGroup->uiPending )
+    pthread_cond_signal(&pGroup->condition);
+  pthread_mutex_unlock(&pGroup->mutex);
+}
+
 int hid_libusb::writeHID(const uint8_t *puiData, size_t uiLength,
                          const bool bFeature)
 {
   if ( ! this->m_bOpenDevice )
     return HID_LIBUSB_NO_DEVICE_OPEN;
 
+  if ( !puiData || !uiLength )
+    return HID_LIBUSB_INVALID_ARGS;
+
+  if ( !bFeature )
+    {
+      // output reports take the transfers of writeHIDAsync(), waited for
+      // like a group of one
+      int iResult;
+      group_write_t group;
+      pthread_mutex_init(&group.mutex, 0);
+      pthread_cond_init(&group.condition, 0);
+      group.uiPending = 1;
+      group.piResults = &iResult;
+      group_member_t member = { &group, 0 };
+
+      const int iQueued = this->writeHIDAsync(puiData, uiLength,
+                                              groupWriteCallback, &member);
+      if ( iQueued < 0 )
+        groupWriteCallback(iQueued, &member);
+
+      pthread_mutex_lock(&group.mutex);
+      while ( group.uiPending )
+        pthread_cond_wait(&group.condition, &group.mutex);
+      pthread_mutex_unlock(&group.mutex);
+
+      pthread_cond_destroy(&group.condition);
+      pthread_mutex_destroy(&group.mutex);
+
+      return iResult;
+    }
+
+  if ( this->m_iCaptureDevice >= 0 )
+    this->m_pCapture->record(this->m_iCaptureDevice, HID_CAPTURE_FEATURE_OUT,
+                             self_type_t::getCaptureTimestamp(),
+                             puiData, uiLength);
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-enum-enum-conversion"
+  int iResult = this->m_pTransport->controlTransfer(
+                      LIBUSB_REQUEST_TYPE_CLASS |
+                      LIBUSB_RECIPIENT_INTERFACE |
+                      LIBUSB_ENDPOINT_OUT,
+                      0x09,
+                      0x300,
+                      this->m_iInterface,
+                      (uint8_t *)puiData,
+                      uiLength,
+                      1000);
+#pragma GCC diagnostic pop
+
+  if ( iResult < 0 )
+    return iResult;
+
+  return uiLength;
+}
+
+int hid_libusb::writeHIDAsync(const uint8_t *puiData, size_t uiLength,
+                              hid_write_callback_t pCallback,
+                              void *pUserData)
+{
+  if ( ! this->m_bOpenDevice )
+    return HID_LIBUSB_NO_DEVICE_OPEN;
+
+  if ( !puiData || !uiLength )
+    return HID_LIBUSB_INVALID_ARGS;
+
+  if ( this->m_bShutdownThread || !this->m_pOutputTransfers )
+    return LIBUSB_ERROR_NO_DEVICE;
+
+  if ( this->m_iCaptureDevice >= 0 )
+    this->m_pCapture->record(this->m_iCaptureDevice, HID_CAPTURE_OUTPUT,
+                             self_type_t::getCaptureTimestamp(),
+                             puiData, uiLength);
+
   const uint8_t uiReportNumber = puiData[0];
   bool bSkippedReportID = false;
-  if ( !uiReportNumber && !bFeature )
+  if ( !uiReportNumber )
     {
       puiData++;
       uiLength--;
       bSkippedReportID = true;
     }
 
-  libusb_wrapper &libusbWrapper = libusb_wrapper::getInstance();
+  write_request_t *pRequest = new write_request_t;
+  pRequest->pCallback = pCallback;
+  pRequest->pUserData = pUserData;
+  pRequest->bSkippedReportID = bSkippedReportID;
 
-  if ( this->m_iOutputEndpoint <= 0 || bFeature )
+  // the request owns a copy, the caller's buffer may be gone before the
+  // report is submitted
+  if ( this->m_iOutputEndpoint <= 0 )
     {
-      const uint16_t uiRequestType = ( bFeature ) ?
-        0x300 : ( 0x200 | uiReportNumber );
+      pRequest->uiLength = LIBUSB_CONTROL_SETUP_SIZE + uiLength;
+      pRequest->puiBuffer = new uint8_t[pRequest->uiLength];
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wdeprecated-enum-enum-conversion"
-      int iResult = libusbWrapper.libusbControlTransfer(
-                          this->m_pDeviceHandle,
-                          LIBUSB_REQUEST_TYPE_CLASS |
-                          LIBUSB_RECIPIENT_INTERFACE |
-                          LIBUSB_ENDPOINT_OUT,
-                          0x09,
-                          uiRequestType,
-                          this->m_iInterface,
-                          (unsigned char *)puiData,
-                          uiLength,
-                          1000);
+      libusb_fill_control_setup(pRequest->puiBuffer,
+                                LIBUSB_REQUEST_TYPE_CLASS |
+                                LIBUSB_RECIPIENT_INTERFACE |
+                                LIBUSB_ENDPOINT_OUT,
+                                0x09,
+                                0x200 | uiReportNumber,
+                                this->m_iInterface,
+                                uiLength);
 #pragma GCC diagnostic pop
+      memcpy(pRequest->puiBuffer + LIBUSB_CONTROL_SETUP_SIZE, puiData,
+             uiLength);
+    }
+  else
+    {
+      pRequest->uiLength = uiLength;
+      pRequest->puiBuffer = new uint8_t[uiLength];
+      memcpy(pRequest->puiBuffer, puiData, uiLength);
+    }
+
+  this->m_iActiveWrites++;
+  this->m_WriteQueue.push(pRequest);
+  this->drainWrites();
+
+  return 0;
+}
+
+int hid_libusb::writeHIDGroup(hid_libusb *const *ppDevices,
+                              const size_t uiDevices,
+                              const uint8_t *const *ppuiData,
+                              const size_t *puiLengths,
+                              int *piResults)
+{
+  if ( !ppDevices || !ppuiData || !puiLengths || !piResults )
+    return HID_LIBUSB_INVALID_ARGS;
+
+  if ( !uiDevices )
+    return 0;
 
+  group_write_t group;
+  pthread_mutex_init(&group.mutex, 0);
+  pthread_cond_init(&group.condition, 0);
+  group.uiPending = uiDevices;
+  group.piResults = piResults;
+
+  // Queue the report on every device before waiting for any of them, the
+  // transfers are in flight side by side and the whole group takes about
+  // one round trip.
+  group_member_t *pMembers = new group_member_t[uiDevices];
+  for ( size_t i = 0; i < uiDevices; i++ )
+    {
+      pMembers[i].pGroup = &group;
+      pMembers[i].uiIndex = i;
+
+      int iResult = HID_LIBUSB_INVALID_ARGS;
+      if ( ppDevices[i] )
+        iResult = ppDevices[i]->writeHIDAsync(ppuiData[i], puiLengths[i],
+                                              groupWriteCallback,
+                                              &pMembers[i]);
       if ( iResult < 0 )
-        return iResult;
+        groupWriteCallback(iResult, &pMembers[i]);
+    }
+
+  pthread_mutex_lock(&group.mutex);
+  while ( group.uiPending )
+    pthread_cond_wait(&group.condition, &group.mutex);
+  pthread_mutex_unlock(&group.mutex);
+
+  pthread_cond_destroy(&group.condition);
+  pthread_mutex_destroy(&group.mutex);
+  delete [] pMembers;
+
+  for ( size_t i = 0; i < uiDevices; i++ )
+    if ( piResults[i] < 0 )
+      return piResults[i];
+
+  return 0;
+}
+
+void hid_libusb::drainWrites()
+{
+  // Only one thread at a time moves queued reports into idle transfers.
+  // Whoever finds it busy leaves a note, which makes the draining thread
+  // go round once more, so no report is left behind in the queue.
+  this->m_bWritesPending = true;
+  while ( !this->m_bDrainingWrites.exchange(true) )
+    {
+      this->m_bWritesPending = false;
+      while ( true )
+        {
+          if ( !this->m_pNextWrite )
+            this->m_pNextWrite = this->m_WriteQueue.pop();
+          if ( !this->m_pNextWrite )
+            break;
 
-      if ( bSkippedReportID )
-        return uiLength++;
-      return uiLength;
+          // the single consumer of the idle stack, pushes come from
+          // completions only, so the head cannot be recycled under us
+          output_transfer_t *pOutput = this->m_pIdleWrites.load();
+          while ( pOutput &&
+                  !this->m_pIdleWrites.compare_exchange_weak(pOutput,
+                                                             pOutput->pNext) )
+            ;
+          if ( !pOutput )
+            break;
+
+          write_request_t *pRequest = this->m_pNextWrite;
+          this->m_pNextWrite = 0;
+          this->submitWrite(pOutput, pRequest);
+        }
+      this->m_bDrainingWrites = false;
+
+      if ( !this->m_bWritesPending )
+        break;
     }
+}
 
-  int iActualLength;
-  int iResult = libusbWrapper.libusbInterruptTransfer(this->m_pDeviceHandle,
-                                                      this->m_iOutputEndpoint,
-                                                      (unsigned char*)puiData,
-                                                      uiLength,
-                                                      &iActualLength,
-                                                      1000);
+void hid_libusb::submitWrite(output_transfer_t *pOutput,
+                             write_request_t *pRequest)
+{
+  pOutput->pRequest = pRequest;
+  if ( this->m_iOutputEndpoint <= 0 )
+    libusb_fill_control_transfer(pOutput->pTransfer,
+                                 this->m_pDeviceHandle,
+                                 pRequest->puiBuffer,
+                                 self_type_t::writeCallback,
+                                 pOutput,
+                                 1000);
+  else
+    libusb_fill_interrupt_transfer(pOutput->pTransfer,
+                                   this->m_pDeviceHandle,
+                                   this->m_iOutputEndpoint,
+                                   pRequest->puiBuffer,
+                                   pRequest->uiLength,
+                                   self_type_t::writeCallback,
+                                   pOutput,
+                                   1000);
+
+  const int iResult = this->m_pTransport->submitTransfer(pOutput->pTransfer);
+  if ( iResult )
+    this->completeWrite(pOutput, iResult);
+}
 
-  if ( iResult < 0 )
-    return iResult;
+void hid_libusb::completeWrite(output_transfer_t *pOutput, const int iResult)
+{
+  write_request_t *pRequest = pOutput->pRequest;
+  if ( pRequest->pCallback )
+    pRequest->pCallback(iResult, pRequest->pUserData);
+  delete [] pRequest->puiBuffer;
+  delete pRequest;
+
+  pOutput->pRequest = 0;
+  pOutput->pNext = this->m_pIdleWrites.load();
+  while ( !this->m_pIdleWrites.compare_exchange_weak(pOutput->pNext, pOutput) )
+    ;
+
+  if ( --this->m_iActiveWrites == 0 && this->m_bShutdownThread )
+    this->notifyRetired();
+}
 
-  if ( bSkippedReportID )
-    iActualLength++;
+void hid_libusb::writeCallback(struct libusb_transfer *pTransfer)
+{
+  output_transfer_t *pOutput =
+    static_cast<output_transfer_t *>(pTransfer->user_data);
+  self_type_t *pThis = pOutput->pDevice;
 
-  return iActualLength;
+  int iResult;
+  switch ( pTransfer->status )
+    {
+    case LIBUSB_TRANSFER_COMPLETED :
+      iResult = pTransfer->actual_length;
+      if ( pOutput->pRequest->bSkippedReportID )
+        iResult++;
+      break;
+    case LIBUSB_TRANSFER_TIMED_OUT :
+      iResult = LIBUSB_ERROR_TIMEOUT;
+      break;
+    case LIBUSB_TRANSFER_STALL :
+      iResult = LIBUSB_ERROR_PIPE;
+      break;
+    case LIBUSB_TRANSFER_NO_DEVICE :
+      iResult = LIBUSB_ERROR_NO_DEVICE;
+      break;
+    case LIBUSB_TRANSFER_OVERFLOW :
+      iResult = LIBUSB_ERROR_OVERFLOW;
+      break;
+    case LIBUSB_TRANSFER_CANCELLED :
+      iResult = LIBUSB_ERROR_INTERRUPTED;
+      break;
+    default :
+      iResult = LIBUSB_ERROR_IO;
+    }
+
+  // refill before the count drops, closeHID() frees the transfers once
+  // it reached zero
+  pThis->m_iActiveWrites++;
+  pThis->completeWrite(pOutput, iResult);
+  pThis->drainWrites();
+  if ( --pThis->m_iActiveWrites == 0 && pThis->m_bShutdownThread )
+    pThis->notifyRetired();
+}
+
+void hid_libusb::allocReportQueues()
+{
+  // never HID_OVERFLOW_BLOCK, see setReportQueue()
+  for ( int i = 0; i < 256; i++ )
+    if ( this->m_abReportQueues[i] )
+      {
+        this->m_apReportQueues[i] = new hid_report_queue;
+        this->m_apReportQueues[i]->init(this->m_uiQueueCapacity,
+                                        this->m_uiMaxPacketSize,
+                                        this->m_eOverflowPolicy);
+      }
+}
+
+void hid_libusb::freeReportQueues()
+{
+  for ( int i = 0; i < 256; i++ )
+    if ( this->m_apReportQueues[i] )
+      {
+        delete this->m_apReportQueues[i];
+        this->m_apReportQueues[i] = 0;
+      }
+}
+
+void hid_libusb::shutdownQueues()
+{
+  this->m_InputReports.shutdown();
+  for ( int i = 0; i < 256; i++ )
+    if ( this->m_apReportQueues[i] )
+      this->m_apReportQueues[i]->shutdown();
+}
+
+int hid_libusb::allocWrites()
+{
+  const size_t uiDepth = this->m_uiOutputDepth;
+
+  this->m_pOutputTransfers = new output_transfer_t[uiDepth];
+  this->m_pIdleWrites = 0;
+  this->m_pNextWrite = 0;
+  for ( size_t i = 0; i < uiDepth; i++ )
+    {
+      output_transfer_t *pOutput = &this->m_pOutputTransfers[i];
+      pOutput->pDevice = this;
+      pOutput->pTransfer = this->m_pTransport->allocTransfer();
+      if ( !pOutput->pTransfer )
+        {
+          for ( size_t j = 0; j < i; j++ )
+            this->m_pTransport->freeTransfer(
+                  this->m_pOutputTransfers[j].pTransfer);
+          delete [] this->m_pOutputTransfers;
+          this->m_pOutputTransfers = 0;
+          this->m_pIdleWrites = 0;
+          return LIBUSB_ERROR_NO_MEM;
+        }
+      pOutput->pRequest = 0;
+      pOutput->pNext = this->m_pIdleWrites;
+      this->m_pIdleWrites = pOutput;
+    }
+
+  return 0;
+}
+
+void hid_libusb::freeWrites()
+{
+  if ( !this->m_pOutputTransfers )
+    return;
+
+  for ( size_t i = 0; i < this->m_uiOutputDepth; i++ )
+    this->m_pTransport->freeTransfer(this->m_pOutputTransfers[i].pTransfer);
+
+  delete [] this->m_pOutputTransfers;
+  this->m_pOutputTransfers = 0;
+  this->m_pIdleWrites = 0;
 }
 
 int hid_libusb::readHID(uint8_t *puiData, size_t uiLength,
-                        int iMilliseconds)
+                        int iMilliseconds, uint64_t *puiTimestamp)
 {
   if ( ! this->m_bOpenDevice )
     return HID_LIBUSB_NO_DEVICE_OPEN;
 
-  int iBytesRead = HID_LIBUSB_READ_ERROR;
+  const int iBytesRead = this->m_InputReports.read(puiData, uiLength,
+                                                   iMilliseconds,
+                                                   puiTimestamp);
+  if ( iBytesRead >= 0 && this->m_iParkedTransfers > 0 )
+    this->resumeTransfers();
 
-  pthread_mutex_lock(&this->m_Mutex);
-  pthread_cleanup_push(&self_type_t::cleanupMutex, this);
+  return iBytesRead;
+}
+
+int hid_libusb::readHID(const uint8_t uiReportID, uint8_t *puiData,
+                        size_t uiLength, int iMilliseconds,
+                        uint64_t *puiTimestamp)
+{
+  if ( ! this->m_bOpenDevice )
+    return HID_LIBUSB_NO_DEVICE_OPEN;
+
+  hid_report_queue *pQueue = this->m_apReportQueues[uiReportID];
+  if ( !pQueue )
+    return HID_LIBUSB_INVALID_ARGS;
+
+  return pQueue->read(puiData, uiLength, iMilliseconds, puiTimestamp);
+}
+
+int hid_libusb::readHIDBatch(uint8_t *puiData, size_t uiLength,
+                             size_t *puiOffsets, size_t *puiLengths,
+                             size_t uiMaxReports, int iMilliseconds,
+                             uint64_t *puiTimestamps)
+{
+  if ( ! this->m_bOpenDevice )
+    return HID_LIBUSB_NO_DEVICE_OPEN;
+
+  if ( !puiData || !puiOffsets || !puiLengths || !uiMaxReports )
+    return HID_LIBUSB_INVALID_ARGS;
+
+  const int iReports = this->m_InputReports.readBatch(puiData, uiLength,
+                                                      puiOffsets,
+                                                      puiLengths,
+                                                      uiMaxReports,
+                                                      iMilliseconds,
+                                                      puiTimestamps);
+  if ( iReports >= 0 && this->m_iParkedTransfers > 0 )
+    this->resumeTransfers();
+
+  return iReports;
+}
+
+static void getDeadline(struct timespec *pTs, const int iMilliseconds)
+{
+  clock_gettime(CLOCK_MONOTONIC, pTs);
+  pTs->tv_sec += iMilliseconds / 1000;
+  pTs->tv_nsec += ( iMilliseconds % 1000 ) * 1000000;
+  if ( pTs->tv_nsec >= 1000000000L )
+    {
+      pTs->tv_sec++;
+      pTs->tv_nsec -= 1000000000L;
+    }
+}
+
+typedef struct transaction_write
+{
+  hid_libusb *pDevice;
+  int         iId;
+} transaction_write_t;
+
+int hid_libusb::submitTransaction(const uint8_t *puiRequest,
+                                  size_t uiRequestLength,
+                                  hid_report_matcher const& matcher,
+                                  hid_transaction_callback_t pCallback,
+                                  void *pUserData,
+                                  int iMilliseconds)
+{
+  if ( ! this->m_bOpenDevice || !this->m_pTransactions )
+    return HID_LIBUSB_NO_DEVICE_OPEN;
+
+  if ( !puiRequest || !uiRequestLength || !pCallback )
+    return HID_LIBUSB_INVALID_ARGS;
 
-  if ( this->m_pInputReports )
-    iBytesRead = this->returnData(puiData, uiLength);
-  else if ( !this->m_bShutdownThread )
+  struct timespec ts;
+  if ( iMilliseconds > 0 )
+    getDeadline(&ts, iMilliseconds);
+
+  // wait for room in the window of outstanding transactions
+  pthread_mutex_lock(&this->m_TransactionMutex);
+  hid_transaction_t *pTransaction = 0;
+  while ( true )
     {
-      if ( iMilliseconds == -1 )
+      for ( size_t i = 0; i < this->m_uiTransactionWindow; i++ )
+        if ( !this->m_pTransactions[i].iId )
+          {
+            pTransaction = &this->m_pTransactions[i];
+            break;
+          }
+      if ( pTransaction )
+        break;
+
+      int iResult = 0;
+      if ( this->m_bShutdownThread )
+        iResult = LIBUSB_ERROR_NO_DEVICE;
+      else if ( iMilliseconds == -1 )
+        pthread_cond_wait(&this->m_TransactionCondition,
+                          &this->m_TransactionMutex);
+      else if ( iMilliseconds <= 0 ||
+                pthread_cond_timedwait(&this->m_TransactionCondition,
+                                       &this->m_TransactionMutex,
+                                       &ts) == ETIMEDOUT )
+        iResult = LIBUSB_ERROR_TIMEOUT;
+      if ( iResult )
         {
-          while ( !this->m_pInputReports && !this->m_bShutdownThread )
-            pthread_cond_wait(&this->m_Condition, &this->m_Mutex);
-          if ( this->m_pInputReports )
-            iBytesRead = this->returnData(puiData, uiLength);
+          pthread_mutex_unlock(&this->m_TransactionMutex);
+          return iResult;
         }
-      else if ( iMilliseconds > 0 )
+    }
+
+  const uint64_t uiSequence = ++this->m_uiTransactionSequence;
+  const int iId = static_cast<int>( uiSequence & 0x7fffffff ) ?
+    static_cast<int>( uiSequence & 0x7fffffff ) : 1;
+  pTransaction->matcher = matcher;
+  pTransaction->pCallback = pCallback;
+  pTransaction->pUserData = pUserData;
+  pTransaction->uiSequence = uiSequence;
+  pTransaction->iId = iId;
+  this->m_iPendingTransactions++;
+  pthread_mutex_unlock(&this->m_TransactionMutex);
+
+  // the transaction is armed before the request leaves, so the reply
+  // cannot overtake it
+  transaction_write_t *pWrite = new transaction_write_t;
+  pWrite->pDevice = this;
+  pWrite->iId = iId;
+  const int iResult = this->writeHIDAsync(puiRequest, uiRequestLength,
+                                          self_type_t::transactionWritten,
+                                          pWrite);
+  if ( iResult < 0 )
+    {
+      delete pWrite;
+      hid_transaction_callback_t pUnused;
+      void *pUnusedData;
+      if ( this->takeTransaction(iId, &pUnused, &pUnusedData) )
+        return iResult;
+    }
+
+  return iId;
+}
+
+bool hid_libusb::takeTransaction(const int iId,
+                                 hid_transaction_callback_t *ppCallback,
+                                 void **ppUserData)
+{
+  bool bFound = false;
+
+  pthread_mutex_lock(&this->m_TransactionMutex);
+  for ( size_t i = 0; this->m_pTransactions &&
+          i < this->m_uiTransactionWindow; i++ )
+    {
+      hid_transaction_t *pTransaction = &this->m_pTransactions[i];
+      if ( pTransaction->iId == iId )
         {
-          struct timespec ts;
-          clock_gettime(CLOCK_REALTIME, &ts);
-          ts.tv_sec += iMilliseconds / 1000;
-          ts.tv_nsec += ( iMilliseconds % 1000 ) * 1000000;
-          if ( ts.tv_nsec >= 1000000000L )
-            {
-              ts.tv_sec++;
-              ts.tv_nsec -= 1000000000L;
-            }
-          while ( !this->m_pInputReports && !this->m_bShutdownThread )
-            {
-              int iResult = pthread_cond_timedwait(&this->m_Condition,
-                                                   &this->m_Mutex, &ts);
-              if ( !iResult )
-                {
-                  if ( this->m_pInputReports)
-                    {
-                      iBytesRead = this->returnData(puiData, uiLength);
-                      break;
-                    }
-                }
-              else if ( iResult == ETIMEDOUT )
-                {
-                  iBytesRead = 0;
-                  break;
-                }
-              else
-                break;
-            }
+          *ppCallback = pTransaction->pCallback;
+          *ppUserData = pTransaction->pUserData;
+          pTransaction->iId = 0;
+          this->m_iPendingTransactions--;
+          pthread_cond_broadcast(&this->m_TransactionCondition);
+          bFound = true;
+          break;
         }
-      else
-        iBytesRead = 0;
     }
-  pthread_mutex_unlock(&this->m_Mutex);
-  pthread_cleanup_pop(0);
+  pthread_mutex_unlock(&this->m_TransactionMutex);
 
-  return iBytesRead;
+  return bFound;
+}
+
+int hid_libusb::cancelTransaction(const int iId)
+{
+  hid_transaction_callback_t pCallback;
+  void *pUserData;
+  if ( !this->takeTransaction(iId, &pCallback, &pUserData) )
+    return LIBUSB_ERROR_NOT_FOUND;
+
+  return 0;
+}
+
+void hid_libusb::transactionWritten(int iResult, void *pUserData)
+{
+  transaction_write_t *pWrite = static_cast<transaction_write_t *>(pUserData);
+
+  // a request that did not go out will not get a reply
+  hid_transaction_callback_t pCallback;
+  void *pTransactionData;
+  if ( iResult < 0 &&
+       pWrite->pDevice->takeTransaction(pWrite->iId, &pCallback,
+                                        &pTransactionData) )
+    pCallback(iResult, 0, 0, 0, pTransactionData);
+
+  delete pWrite;
+}
+
+bool hid_libusb::matchTransaction(const uint8_t *puiData, size_t uiLength,
+                                  uint64_t uiTimestamp)
+{
+  pthread_mutex_lock(&this->m_TransactionMutex);
+
+  // the oldest outstanding transaction wins, pipelined requests with the
+  // same matcher get their replies in order
+  hid_transaction_t *pMatch = 0;
+  for ( size_t i = 0; i < this->m_uiTransactionWindow; i++ )
+    {
+      hid_transaction_t *pTransaction = &this->m_pTransactions[i];
+      if ( pTransaction->iId &&
+           ( !pMatch || pTransaction->uiSequence < pMatch->uiSequence ) &&
+           pTransaction->matcher.matches(puiData, uiLength) )
+        pMatch = pTransaction;
+    }
+
+  if ( !pMatch )
+    {
+      pthread_mutex_unlock(&this->m_TransactionMutex);
+      return false;
+    }
+
+  hid_transaction_callback_t pCallback = pMatch->pCallback;
+  void *pUserData = pMatch->pUserData;
+  pMatch->iId = 0;
+  this->m_iPendingTransactions--;
+  pthread_cond_broadcast(&this->m_TransactionCondition);
+  pthread_mutex_unlock(&this->m_TransactionMutex);
+
+  pCallback(uiLength, puiData, uiLength, uiTimestamp, pUserData);
+  return true;
+}
+
+void hid_libusb::failTransactions(const int iError)
+{
+  if ( !this->m_pTransactions )
+    return;
+
+  std::vector<std::pair<hid_transaction_callback_t, void *> > failed;
+
+  pthread_mutex_lock(&this->m_TransactionMutex);
+  for ( size_t i = 0; i < this->m_uiTransactionWindow; i++ )
+    {
+      hid_transaction_t *pTransaction = &this->m_pTransactions[i];
+      if ( pTransaction->iId )
+        {
+          failed.push_back(std::make_pair(pTransaction->pCallback,
+                                          pTransaction->pUserData));
+          pTransaction->iId = 0;
+        }
+    }
+  this->m_iPendingTransactions = 0;
+  pthread_cond_broadcast(&this->m_TransactionCondition);
+  pthread_mutex_unlock(&this->m_TransactionMutex);
+
+  for ( size_t i = 0; i < failed.size(); i++ )
+    failed[i].first(iError, 0, 0, 0, failed[i].second);
+}
+
+typedef struct transaction_wait
+{
+  uint8_t  *puiReply;
+  size_t    uiLength;
+  uint64_t *puiTimestamp;
+  int       iResult;
+  bool      bDone;
+  hid_libusb *pDevice;
+} transaction_wait_t;
+
+void hid_libusb::transactionDone(int iResult, const uint8_t *puiReply,
+                                 size_t uiLength, uint64_t uiTimestamp,
+                                 void *pUserData)
+{
+  transaction_wait_t *pWait = static_cast<transaction_wait_t *>(pUserData);
+
+  if ( iResult >= 0 )
+    {
+      if ( uiLength > pWait->uiLength )
+        uiLength = pWait->uiLength;
+      memcpy(pWait->puiReply, puiReply, uiLength);
+      if ( pWait->puiTimestamp )
+        *pWait->puiTimestamp = uiTimestamp;
+      iResult = uiLength;
+    }
+
+  self_type_t *pThis = pWait->pDevice;
+  pthread_mutex_lock(&pThis->m_TransactionMutex);
+  pWait->iResult = iResult;
+  pWait->bDone = true;
+  pthread_cond_broadcast(&pThis->m_TransactionCondition);
+  pthread_mutex_unlock(&pThis->m_TransactionMutex);
+}
+
+int hid_libusb::transactHID(const uint8_t *puiRequest, size_t uiRequestLength,
+                            hid_report_matcher const& matcher,
+                            uint8_t *puiReply, size_t uiReplyLength,
+                            int iMilliseconds, uint64_t *puiTimestamp)
+{
+  if ( !puiReply && uiReplyLength )
+    return HID_LIBUSB_INVALID_ARGS;
+
+  struct timespec ts;
+  if ( iMilliseconds > 0 )
+    getDeadline(&ts, iMilliseconds);
+
+  transaction_wait_t wait;
+  wait.puiReply = puiReply;
+  wait.uiLength = uiReplyLength;
+  wait.puiTimestamp = puiTimestamp;
+  wait.iResult = 0;
+  wait.bDone = false;
+  wait.pDevice = this;
+
+  const int iId = this->submitTransaction(puiRequest, uiRequestLength,
+                                          matcher,
+                                          self_type_t::transactionDone,
+                                          &wait, iMilliseconds);
+  if ( iId < 0 )
+    return iId;
+
+  pthread_mutex_lock(&this->m_TransactionMutex);
+  bool bCancel = false;
+  while ( !wait.bDone )
+    {
+      if ( iMilliseconds == -1 || bCancel )
+        pthread_cond_wait(&this->m_TransactionCondition,
+                          &this->m_TransactionMutex);
+      else if ( iMilliseconds <= 0 ||
+                pthread_cond_timedwait(&this->m_TransactionCondition,
+                                       &this->m_TransactionMutex,
+                                       &ts) == ETIMEDOUT )
+        {
+          pthread_mutex_unlock(&this->m_TransactionMutex);
+          if ( !this->cancelTransaction(iId) )
+            return LIBUSB_ERROR_TIMEOUT;
+
+          // the reply is being handed over right now, wait for it
+          pthread_mutex_lock(&this->m_TransactionMutex);
+          bCancel = true;
+        }
+    }
+  pthread_mutex_unlock(&this->m_TransactionMutex);
+
+  return wait.iResult;
 }
 
 int hid_libusb::readFeature(uint8_t *puiData, size_t uiLength,
@@ -734,8 +1924,7 @@ int hid_libusb::readFeature(uint8_t *puiData, size_t uiLength,
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wdeprecated-enum-enum-conversion"
-  int iResult = libusb_wrapper::getInstance().libusbControlTransfer(
-                       this->m_pDeviceHandle,
+  int iResult = this->m_pTransport->controlTransfer(
                        LIBUSB_ENDPOINT_IN |
                        LIBUSB_REQUEST_TYPE_CLASS |
                        LIBUSB_RECIPIENT_INTERFACE,
@@ -747,12 +1936,27 @@ int hid_libusb::readFeature(uint8_t *puiData, size_t uiLength,
                        iMilliseconds);
 #pragma GCC diagnostic pop
 
+  if ( iResult > 0 && this->m_iCaptureDevice >= 0 )
+    this->m_pCapture->record(this->m_iCaptureDevice, HID_CAPTURE_FEATURE_IN,
+                             self_type_t::getCaptureTimestamp(),
+                             puiData, iResult);
+
   return iResult;
 }
 
 int hid_libusb::openHID(const uint16_t vid, const uint16_t pid,
                         std::string const& serial)
 {
+  // by serial the registry finds the interface without enumerating, a
+  // device it does not know (yet) is searched for like before
+  if ( vid && pid && !serial.empty() )
+    {
+      const int iResult = this->openRegisteredHID(vid, pid, serial);
+      if ( iResult != HID_LIBUSB_NO_DEVICE &&
+           iResult != LIBUSB_ERROR_NO_DEVICE )
+        return iResult;
+    }
+
   int iResult = this->enumerateHID(vid, pid);
   if ( iResult < 0 )
     return iResult;
@@ -777,6 +1981,27 @@ int hid_libusb::openHID(const uint16_t vid, const uint16_t pid,
   return iResult;
 }
 
+int hid_libusb::openRegisteredHID(const uint16_t vid, const uint16_t pid,
+                                  std::string const& serial)
+{
+  int iResult = self_type_t::initContext();
+  if ( iResult < 0 )
+    return iResult;
+
+  hid_device_registry &registry = hid_device_registry::getInstance();
+  if ( !registry.attach(self_type_t::m_pContext) )
+    return HID_LIBUSB_NO_DEVICE;
+
+  hid_device_info_t device;
+  iResult = registry.findSerial(vid, pid, serial, &device);
+  if ( iResult < 0 )
+    return iResult;
+
+  // only read by openHIDDevice()
+  device.szSerial = const_cast<char *>(serial.c_str());
+  return this->openHIDDevice(&device);
+}
+
 void hid_libusb::closeHID()
 {
   if ( ! this->m_bOpenDevice )
@@ -784,14 +2009,36 @@ void hid_libusb::closeHID()
 
   libusb_wrapper &libusbWrapper = libusb_wrapper::getInstance();
 
+  // no report callback runs once this returns
+  this->stopDispatch();
+  // Under the lock, a reader resuming parked transfers has either
+  // submitted them before, and they are cancelled below, or sees the
+  // shutdown.  Readers still inside resumeTransfers() are waited for.
+  pthread_mutex_lock(&this->m_TransferMutex);
   this->m_bShutdownThread = true;
-  if ( this->m_pTransfer )
+  pthread_mutex_unlock(&this->m_TransferMutex);
+  while ( this->m_iResumingReaders > 0 )
+    sched_yield();
+  if ( this->m_ppTransfers )
     {
-      libusbWrapper.libusbCancelTransfer(this->m_pTransfer);
-      pthread_join(this->m_Thread, 0);
-      libusbWrapper.libusbFreeTransfer(this->m_pTransfer);
-      this->m_pTransfer = 0;
+      this->cancelTransfers();
+      if ( this->m_bDedicatedThread )
+        pthread_join(this->m_Thread, 0);
+      else
+        {
+          this->waitTransfers();
+          self_type_t::releaseEventLoop();
+        }
+      this->freeTransfers();
     }
+  this->freeWrites();
+  delete this->m_pTransport;
+  this->m_pTransport = 0;
+  this->failTransactions(LIBUSB_ERROR_INTERRUPTED);
+  delete [] this->m_pTransactions;
+  this->m_pTransactions = 0;
+  this->shutdownQueues();
+  this->retireFilters();
 
   if ( this->m_pDeviceHandle )
     {
@@ -804,12 +2051,113 @@ void hid_libusb::closeHID()
       this->m_pDeviceHandle = 0;
     }
 
-  pthread_barrier_destroy(&this->m_Barrier);
-  pthread_cond_destroy(&this->m_Condition);
-  pthread_mutex_destroy(&this->m_Mutex);
+  pthread_barrier_destroy(&this->m_Barrier);
+  pthread_cond_destroy(&this->m_TransferCondition);
+  pthread_mutex_destroy(&this->m_TransferMutex);
+  this->m_InputReports.destroy();
+  this->freeReportQueues();
+
+  this->m_iCaptureDevice = -1;
+  this->m_bOpenDevice = false;
+  this->m_bDetachedKernel = false;
+}
+
+int hid_libusb::openReplay(std::string const& path,
+                           const hid_replay_speed eSpeed,
+                           const double dScale, const int iDevice)
+{
+  if ( ( eSpeed == HID_REPLAY_SCALED && !( dScale > 0 ) ) || iDevice > 0xffff )
+    return HID_LIBUSB_INVALID_ARGS;
+
+  hid_replay_transport *pReplay = new hid_replay_transport(eSpeed, dScale,
+                                                           iDevice);
+  const int iResult = pReplay->open(path);
+  if ( iResult < 0 )
+    {
+      delete pReplay;
+      return iResult;
+    }
+
+  return this->openTransport(pReplay);
+}
+
+int hid_libusb::openMock(const double dRate, const size_t uiReportSize,
+                         const uint32_t uiJitterUs, const uint64_t uiReports,
+                         const bool bEcho)
+{
+  if ( !( dRate >= 0 ) || !uiReportSize )
+    return HID_LIBUSB_INVALID_ARGS;
+
+  return this->openTransport(new hid_mock_transport(dRate, uiReportSize,
+                                                    uiJitterUs, uiReports,
+                                                    bEcho));
+}
+
+int hid_libusb::openTransport(hid_emulated_transport *pTransport)
+{
+  if ( !pTransport )
+    return HID_LIBUSB_INVALID_ARGS;
+
+  this->closeHID();
+
+  if ( !pTransport->reportSize() )
+    {
+      delete pTransport;
+      return HID_LIBUSB_INVALID_ARGS;
+    }
+
+  // the endpoints an emulated device has, the transfers are the same as
+  // for a real one
+  this->m_pTransport = pTransport;
+  this->m_bShutdownThread = false;
+  this->m_iInputEndpoint = LIBUSB_ENDPOINT_IN | 1;
+  this->m_iOutputEndpoint = LIBUSB_ENDPOINT_OUT | 1;
+  this->m_iInterface = 0;
+  this->m_uiMaxPacketSize = pTransport->reportSize();
+
+  pthread_barrier_init(&this->m_Barrier, NULL, 2);
+  pthread_cond_init(&this->m_TransferCondition, 0);
+  pthread_mutex_init(&this->m_TransferMutex, 0);
+
+  int iResult = this->m_InputReports.init(this->m_uiQueueCapacity,
+                                          this->m_uiMaxPacketSize,
+                                          this->m_eOverflowPolicy);
+  if ( iResult >= 0 )
+    {
+      this->allocReportQueues();
+      iResult = this->allocWrites();
+    }
+  this->addCaptureDevice(0, 0, 0, 0, -1, pTransport->getName().c_str());
+  this->m_pTransactions = new hid_transaction_t[this->m_uiTransactionWindow];
+  for ( size_t i = 0; i < this->m_uiTransactionWindow; i++ )
+    this->m_pTransactions[i].iId = 0;
+  this->m_iPendingTransactions = 0;
+  this->m_uiFilteredReports = 0;
+  // the events are the transport's own, nothing to share
+  this->m_bDedicatedThread = true;
+  this->m_bOpenDevice = true;
+
+  if ( iResult < 0 )
+    {
+      this->closeHID();
+      return iResult;
+    }
+  if ( pthread_create(&this->m_Thread, 0, self_type_t::readThread, this) )
+    {
+      this->closeHID();
+      return LIBUSB_ERROR_OTHER;
+    }
+  pthread_barrier_wait(&this->m_Barrier);
+  if ( this->m_iStartResult < 0 )
+    {
+      pthread_join(this->m_Thread, 0);
+      this->closeHID();
+      return this->m_iStartResult;
+    }
+
+  this->restartDispatch();
 
-  this->m_bOpenDevice = false;
-  this->m_bDetachedKernel = false;
+  return 0;
 }
 
 int hid_libusb::openHIDDevice(const hid_device_info_t *pDeviceToOpen)
@@ -819,15 +2167,9 @@ int hid_libusb::openHIDDevice(const hid_device_info_t *pDeviceToOpen)
 
   libusb_wrapper &libusbWrapper = libusb_wrapper::getInstance();
 
-  if ( ! self_type_t::m_pContext )
-    {
-      if ( !libusbWrapper.loadUSBLib() )
-        return HID_LIBUSB_NO_LIBUSB;
-      int iResult = libusbWrapper.libusbInit(&self_type_t::m_pContext);
-      if ( iResult < 0 )
-        return iResult;
-      atexit(self_type_t::freeHID);
-    }
+  const int iInit = self_type_t::initContext();
+  if ( iInit < 0 )
+    return iInit;
 
   this->closeHID();
 
@@ -835,12 +2177,19 @@ int hid_libusb::openHIDDevice(const hid_device_info_t *pDeviceToOpen)
   this->m_iInputEndpoint = 0;
   this->m_iOutputEndpoint = 0;
 
-  pthread_mutex_init(&this->m_Mutex, 0);
-  pthread_cond_init(&this->m_Condition, 0);
   pthread_barrier_init(&this->m_Barrier, NULL, 2);
-
-  libusb_device **ppList;
-  libusbWrapper.libusbGetDeviceList(self_type_t::m_pContext, &ppList);
+  pthread_cond_init(&this->m_TransferCondition, 0);
+  pthread_mutex_init(&this->m_TransferMutex, 0);
+
+  // a device the registry knows is opened without walking the device list
+  libusb_device *apRegistered[2] = { 0, 0 };
+  libusb_device **ppList = apRegistered;
+  if ( hid_device_registry::getInstance().attach(self_type_t::m_pContext) )
+    apRegistered[0] =
+      hid_device_registry::getInstance().findDevice(pDeviceToOpen);
+  if ( !apRegistered[0] &&
+       libusbWrapper.libusbGetDeviceList(self_type_t::m_pContext, &ppList) < 0 )
+    ppList = apRegistered;
 
   libusb_device *pDev;
   int d = 0;
@@ -953,10 +2302,59 @@ int hid_libusb::openHIDDevice(const hid_device_info_t *pDeviceToOpen)
                                bIsInterrupt && bIsOutput )
                             this->m_iOutputEndpoint = pEndpoint->bEndpointAddress;
                         }
-                      pthread_create(&this->m_Thread,
-                                     0,
-                                     self_type_t::readThread, this);
-                      pthread_barrier_wait(&this->m_Barrier);
+                      this->m_pTransport = new hid_libusb_transport(
+                            self_type_t::m_pContext, this->m_pDeviceHandle,
+                            this->m_uiMaxPacketSize,
+                            pDeviceToOpen->szSerial ?
+                            pDeviceToOpen->szSerial : "");
+                      // a wMaxPacketSize of 0 leaves no room for reports
+                      iResult = this->m_InputReports.init(
+                                      this->m_uiQueueCapacity,
+                                      this->m_uiMaxPacketSize,
+                                      this->m_eOverflowPolicy);
+                      if ( iResult >= 0 )
+                        {
+                          this->allocReportQueues();
+                          iResult = this->allocWrites();
+                        }
+                      this->addCaptureDevice(pDeviceToOpen->uiVendorID,
+                                             pDeviceToOpen->uiProductID,
+                                             pDeviceToOpen->uiBusNumber,
+                                             pDeviceToOpen->uiDeviceAddress,
+                                             pDeviceToOpen->iInterfaceNumber,
+                                             pDeviceToOpen->szSerial);
+                      this->m_pTransactions =
+                        new hid_transaction_t[this->m_uiTransactionWindow];
+                      for ( size_t i = 0; i < this->m_uiTransactionWindow; i++ )
+                        this->m_pTransactions[i].iId = 0;
+                      this->m_iPendingTransactions = 0;
+                      this->m_uiFilteredReports = 0;
+                      // closed again below
+                      if ( iResult < 0 )
+                        break;
+                      // fall back to an own thread if the shared event
+                      // loop cannot be started
+                      this->m_bDedicatedThread = this->m_bUseDedicatedThread ||
+                        self_type_t::acquireEventLoop() < 0;
+                      if ( this->m_bDedicatedThread )
+                        {
+                          iResult = LIBUSB_ERROR_OTHER;
+                          if ( !pthread_create(&this->m_Thread,
+                                               0,
+                                               self_type_t::readThread, this) )
+                            {
+                              pthread_barrier_wait(&this->m_Barrier);
+                              iResult = this->m_iStartResult;
+                              if ( iResult < 0 )
+                                pthread_join(this->m_Thread, 0);
+                            }
+                        }
+                      else
+                        {
+                          iResult = this->startTransfers();
+                          if ( iResult < 0 )
+                            self_type_t::releaseEventLoop();
+                        }
                       break;
                     }
                 }
@@ -965,26 +2363,371 @@ int hid_libusb::openHIDDevice(const hid_device_info_t *pDeviceToOpen)
       libusbWrapper.libusbFreeConfigDescriptor(pConfDesc);
     }
 
-  libusbWrapper.libusbFreeDeviceList(ppList, 1);
+  if ( apRegistered[0] )
+    libusbWrapper.libusbUnrefDevice(apRegistered[0]);
+  else if ( ppList != apRegistered )
+    libusbWrapper.libusbFreeDeviceList(ppList, 1);
 
   if ( bGoodOpen )
     {
       this->findUdevPath();
       this->m_bOpenDevice = true;
+      if ( iResult < 0 )
+        {
+          // claimed, but the transfers did not start
+          this->closeHID();
+          return iResult;
+        }
+      this->restartDispatch();
       return 0;
     }
 
   pthread_barrier_destroy(&this->m_Barrier);
-  pthread_cond_destroy(&this->m_Condition);
-  pthread_mutex_destroy(&this->m_Mutex);
+  pthread_cond_destroy(&this->m_TransferCondition);
+  pthread_mutex_destroy(&this->m_TransferMutex);
+  this->m_InputReports.destroy();
 
   return iResult;
 }
 
+int hid_libusb::setTransferDepth(const size_t uiDepth)
+{
+  if ( !uiDepth )
+    return HID_LIBUSB_INVALID_ARGS;
+
+  // takes effect with the next openHID(), the running transfers are sized
+  // from the depth they were allocated with
+  if ( this->m_bOpenDevice )
+    return HID_LIBUSB_DEVICE_BUSY;
+
+  this->m_uiTransferDepth = uiDepth;
+  return 0;
+}
+
+size_t hid_libusb::getTransferDepth() const
+{
+  return this->m_uiTransferDepth;
+}
+
+int hid_libusb::setQueueCapacity(const size_t uiCapacity)
+{
+  if ( !uiCapacity )
+    return HID_LIBUSB_INVALID_ARGS;
+
+  if ( this->m_bOpenDevice )
+    return HID_LIBUSB_DEVICE_BUSY;
+
+  this->m_uiQueueCapacity = uiCapacity;
+  return 0;
+}
+
+size_t hid_libusb::getQueueCapacity() const
+{
+  return this->m_uiQueueCapacity;
+}
+
+int hid_libusb::setOverflowPolicy(const hid_overflow_policy ePolicy)
+{
+  if ( ePolicy != HID_OVERFLOW_DROP_OLDEST &&
+       ePolicy != HID_OVERFLOW_DROP_NEWEST &&
+       ePolicy != HID_OVERFLOW_BLOCK )
+    return HID_LIBUSB_INVALID_ARGS;
+
+  if ( this->m_bOpenDevice )
+    return HID_LIBUSB_DEVICE_BUSY;
+
+  if ( ePolicy == HID_OVERFLOW_BLOCK )
+    for ( int i = 0; i < 256; i++ )
+      if ( this->m_abReportQueues[i] )
+        return HID_LIBUSB_INVALID_ARGS;
+
+  this->m_eOverflowPolicy = ePolicy;
+  return 0;
+}
+
+hid_overflow_policy hid_libusb::getOverflowPolicy() const
+{
+  return this->m_eOverflowPolicy;
+}
+
+uint64_t hid_libusb::getDroppedReports() const
+{
+  uint64_t uiDropped = this->m_InputReports.dropped();
+  for ( int i = 0; i < 256; i++ )
+    if ( this->m_apReportQueues[i] )
+      uiDropped += this->m_apReportQueues[i]->dropped();
+  return uiDropped;
+}
+
+int hid_libusb::setTimestampClock(const int iClock)
+{
+  if ( iClock != CLOCK_MONOTONIC && iClock != CLOCK_MONOTONIC_RAW )
+    return HID_LIBUSB_INVALID_ARGS;
+
+  this->m_iTimestampClock = iClock;
+  return 0;
+}
+
+int hid_libusb::getTimestampClock() const
+{
+  return this->m_iTimestampClock;
+}
+
+int hid_libusb::getInputFD()
+{
+  if ( ! this->m_bOpenDevice )
+    return HID_LIBUSB_NO_DEVICE_OPEN;
+
+  // valid until closeHID(), remove it from any poll set before closing
+  return this->m_InputReports.eventFD();
+}
+
+int hid_libusb::getInputFD(const uint8_t uiReportID)
+{
+  if ( ! this->m_bOpenDevice )
+    return HID_LIBUSB_NO_DEVICE_OPEN;
+
+  if ( !this->m_apReportQueues[uiReportID] )
+    return HID_LIBUSB_INVALID_ARGS;
+
+  return this->m_apReportQueues[uiReportID]->eventFD();
+}
+
+void hid_libusb::publishFilter(hid_input_filter_t *pFilter)
+{
+  // The event thread may still be looking at the old set, it is tagged
+  // with the filter epoch of the moment it was replaced.
+  hid_input_filter_t *pOld = this->m_pInputFilter.exchange(pFilter);
+  if ( pOld )
+    {
+      pOld->uiRetiredEpoch = this->m_uiFilterEpoch.load();
+      pOld->pRetired = this->m_pRetiredFilters;
+      this->m_pRetiredFilters = pOld;
+    }
+  this->reclaimFilters();
+}
+
+// called with m_FilterMutex held
+void hid_libusb::reclaimFilters()
+{
+  // An even epoch was taken between two reports, the next one loads the
+  // new set.  An odd one is over as soon as the epoch moved on.
+  const uint64_t uiEpoch = this->m_uiFilterEpoch.load();
+  hid_input_filter_t **ppFilter = &this->m_pRetiredFilters;
+  while ( *ppFilter )
+    {
+      hid_input_filter_t *pFilter = *ppFilter;
+      if ( !( pFilter->uiRetiredEpoch & 1 ) ||
+           pFilter->uiRetiredEpoch != uiEpoch )
+        {
+          *ppFilter = pFilter->pRetired;
+          delete pFilter;
+        }
+      else
+        ppFilter = &pFilter->pRetired;
+    }
+}
+
+void hid_libusb::retireFilters()
+{
+  pthread_mutex_lock(&this->m_FilterMutex);
+  while ( this->m_pRetiredFilters )
+    {
+      hid_input_filter_t *pFilter = this->m_pRetiredFilters;
+      this->m_pRetiredFilters = pFilter->pRetired;
+      delete pFilter;
+    }
+  pthread_mutex_unlock(&this->m_FilterMutex);
+}
+
+int hid_libusb::addInputFilter(hid_report_matcher const& matcher)
+{
+  pthread_mutex_lock(&this->m_FilterMutex);
+  const hid_input_filter_t *pCurrent = this->m_pInputFilter.load();
+  hid_input_filter_t *pFilter = new hid_input_filter_t;
+  pFilter->pPredicate = pCurrent ? pCurrent->pPredicate : 0;
+  pFilter->pUserData = pCurrent ? pCurrent->pUserData : 0;
+  pFilter->pRetired = 0;
+  if ( pCurrent )
+    pFilter->drops = pCurrent->drops;
+  pFilter->drops.push_back(matcher);
+  const int iFilters = pFilter->drops.size();
+  this->publishFilter(pFilter);
+  pthread_mutex_unlock(&this->m_FilterMutex);
+
+  return iFilters;
+}
+
+void hid_libusb::clearInputFilters()
+{
+  pthread_mutex_lock(&this->m_FilterMutex);
+  const hid_input_filter_t *pCurrent = this->m_pInputFilter.load();
+  hid_input_filter_t *pFilter = 0;
+  if ( pCurrent && pCurrent->pPredicate )
+    {
+      pFilter = new hid_input_filter_t;
+      pFilter->pPredicate = pCurrent->pPredicate;
+      pFilter->pUserData = pCurrent->pUserData;
+      pFilter->pRetired = 0;
+    }
+  this->publishFilter(pFilter);
+  pthread_mutex_unlock(&this->m_FilterMutex);
+}
+
+void hid_libusb::setInputPredicate(hid_input_predicate_t pPredicate,
+                                   void *pUserData)
+{
+  pthread_mutex_lock(&this->m_FilterMutex);
+  const hid_input_filter_t *pCurrent = this->m_pInputFilter.load();
+  hid_input_filter_t *pFilter = 0;
+  if ( pPredicate || ( pCurrent && !pCurrent->drops.empty() ) )
+    {
+      pFilter = new hid_input_filter_t;
+      pFilter->pPredicate = pPredicate;
+      pFilter->pUserData = pUserData;
+      pFilter->pRetired = 0;
+      if ( pCurrent )
+        pFilter->drops = pCurrent->drops;
+    }
+  this->publishFilter(pFilter);
+  pthread_mutex_unlock(&this->m_FilterMutex);
+}
+
+uint64_t hid_libusb::getFilteredReports() const
+{
+  return this->m_uiFilteredReports.load();
+}
+
+int hid_libusb::setReportQueue(const uint8_t uiReportID, const bool bEnable)
+{
+  // the event thread routes by a table that is only built on open
+  if ( this->m_bOpenDevice )
+    return HID_LIBUSB_DEVICE_BUSY;
+
+  // A slow reader of one report ID must not hold up the endpoint all IDs
+  // share, lossless backpressure has no credits per queue.
+  if ( bEnable && this->m_eOverflowPolicy == HID_OVERFLOW_BLOCK )
+    return HID_LIBUSB_INVALID_ARGS;
+
+  this->m_abReportQueues[uiReportID] = bEnable;
+  return 0;
+}
+
+bool hid_libusb::getReportQueue(const uint8_t uiReportID) const
+{
+  return this->m_abReportQueues[uiReportID];
+}
+
+void hid_libusb::addCaptureDevice(const uint16_t uiVendorID,
+                                  const uint16_t uiProductID,
+                                  const uint16_t uiBusNumber,
+                                  const uint16_t uiDeviceAddress,
+                                  const int32_t iInterfaceNumber,
+                                  const char *szSerial)
+{
+  // A capture without room for another device leaves this one out, it
+  // does not keep the device from opening.
+  this->m_iCaptureDevice = -1;
+  if ( !this->m_pCapture )
+    return;
+
+  const int iDevice = this->m_pCapture->addDevice(uiVendorID, uiProductID,
+                                                  uiBusNumber,
+                                                  uiDeviceAddress,
+                                                  iInterfaceNumber, szSerial);
+  if ( iDevice >= 0 )
+    this->m_iCaptureDevice = iDevice;
+}
+
+int hid_libusb::setCapture(hid_capture *pCapture)
+{
+  // read without synchronisation on the event thread
+  if ( this->m_bOpenDevice )
+    return HID_LIBUSB_DEVICE_BUSY;
+
+  this->m_pCapture = pCapture;
+  return 0;
+}
+
+int hid_libusb::setDedicatedEventThread(const bool bDedicated)
+{
+  if ( this->m_bOpenDevice )
+    return HID_LIBUSB_DEVICE_BUSY;
+
+  this->m_bUseDedicatedThread = bDedicated;
+  return 0;
+}
+
+bool hid_libusb::getDedicatedEventThread() const
+{
+  return this->m_bUseDedicatedThread;
+}
+
+int hid_libusb::setOutputDepth(const size_t uiDepth)
+{
+  if ( !uiDepth )
+    return HID_LIBUSB_INVALID_ARGS;
+
+  if ( this->m_bOpenDevice )
+    return HID_LIBUSB_DEVICE_BUSY;
+
+  this->m_uiOutputDepth = uiDepth;
+  return 0;
+}
+
+size_t hid_libusb::getOutputDepth() const
+{
+  return this->m_uiOutputDepth;
+}
+
+size_t hid_libusb::getQueuedWrites() const
+{
+  return this->m_WriteQueue.size();
+}
+
+int hid_libusb::setTransactionWindow(const size_t uiWindow)
+{
+  if ( !uiWindow )
+    return HID_LIBUSB_INVALID_ARGS;
+
+  if ( this->m_bOpenDevice )
+    return HID_LIBUSB_DEVICE_BUSY;
+
+  this->m_uiTransactionWindow = uiWindow;
+  return 0;
+}
+
+size_t hid_libusb::getTransactionWindow() const
+{
+  return this->m_uiTransactionWindow;
+}
+
+int hid_libusb::initContext()
+{
+  if ( self_type_t::m_pContext )
+    return 0;
+
+  libusb_wrapper &libusbWrapper = libusb_wrapper::getInstance();
+  if ( !libusbWrapper.loadUSBLib() )
+    return HID_LIBUSB_NO_LIBUSB;
+  const int iResult = libusbWrapper.libusbInit(&self_type_t::m_pContext);
+  if ( iResult < 0 )
+    return iResult;
+  // constructed first, the registry is still there when freeHID() runs
+  hid_device_registry::getInstance();
+  atexit(self_type_t::freeHID);
+
+  return 0;
+}
+
 void hid_libusb::freeHID()
 {
   if ( self_type_t::m_pContext )
-    libusb_wrapper::getInstance().libusbExit(self_type_t::m_pContext);
+    {
+      // the registry holds references to devices of the context
+      hid_device_registry::getInstance().detach();
+      libusb_wrapper::getInstance().libusbExit(self_type_t::m_pContext);
+    }
 }
 
 int hid_libusb::waitDeviceReAdd(const uint16_t uiTimeout)
@@ -1095,6 +2838,12 @@ void hid_libusb::getErrorString(const int iError,
         case HID_LIBUSB_NO_LIBUSB :
           szError += "Failed to load libusb-1.0.so.0.";
           break;
+        case HID_LIBUSB_DEVICE_BUSY :
+          szError += "Setting cannot be changed while the HID device is open.";
+          break;
+        case HID_LIBUSB_FILE_ERROR :
+          szError += "Failed to open or write the capture file.";
+          break;
         default :
           szError += "Unknown error.";
         }
@@ -1126,3 +2875,163 @@ std::vector<uint8_t> hid_libusb::readHID(size_t const size, int const timeout)
 	}
 	return data;
 }
+
+std::pair<std::vector<uint8_t>, uint64_t>
+hid_libusb::readHIDTimestamped(size_t const size, int const timeout)
+{
+	std::pair<std::vector<uint8_t>, uint64_t> report(std::vector<uint8_t>(size), 0);
+	int ret = readHID(report.first.data(), size, timeout, &report.second);
+	if (ret < 0) {
+		std::string message;
+		getErrorString(ret, message);
+		throw std::runtime_error(message);
+	} else {
+		report.first.resize(ret);
+	}
+	return report;
+}
+
+static void resolveWrite(int const ret, void* user)
+{
+	std::promise<int>* promise = static_cast<std::promise<int>*>(user);
+	if (ret < 0) {
+		std::string message;
+		hid_libusb::getErrorString(ret, message);
+		promise->set_exception(std::make_exception_ptr(std::runtime_error(message)));
+	} else
+		promise->set_value(ret);
+	delete promise;
+}
+
+std::future<int> hid_libusb::writeHIDAsync(std::vector<uint8_t> const& data)
+{
+	std::promise<int>* promise = new std::promise<int>;
+	std::future<int> result = promise->get_future();
+	int ret = writeHIDAsync(data.data(), data.size(), resolveWrite, promise);
+	if (ret < 0)
+		resolveWrite(ret, promise);
+	return result;
+}
+
+std::vector<int> hid_libusb::writeHIDGroup(std::vector<hid_libusb*> const& devices,
+                                           std::vector<uint8_t> const& report)
+{
+	std::vector<uint8_t const*> data(devices.size(), report.data());
+	std::vector<size_t> lengths(devices.size(), report.size());
+	std::vector<int> results(devices.size());
+	writeHIDGroup(devices.data(), devices.size(), data.data(), lengths.data(), results.data());
+	return results;
+}
+
+std::vector<int> hid_libusb::writeHIDGroup(std::vector<hid_libusb*> const& devices,
+                                           std::vector<std::vector<uint8_t> > const& reports)
+{
+	if (reports.size() != devices.size())
+		throw std::invalid_argument("hid_libusb::writeHIDGroup: need one report per device");
+
+	std::vector<uint8_t const*> data(devices.size());
+	std::vector<size_t> lengths(devices.size());
+	for (size_t i = 0; i < devices.size(); i++) {
+		data[i] = reports[i].data();
+		lengths[i] = reports[i].size();
+	}
+	std::vector<int> results(devices.size());
+	writeHIDGroup(devices.data(), devices.size(), data.data(), lengths.data(), results.data());
+	return results;
+}
+
+std::vector<uint8_t> hid_libusb::transactHID(std::vector<uint8_t> const& request,
+                                             hid_report_matcher const& matcher,
+                                             size_t const size,
+                                             int const timeout)
+{
+	std::vector<uint8_t> reply(size);
+	int ret = transactHID(request.data(), request.size(), matcher, reply.data(), size, timeout);
+	if (ret < 0) {
+		std::string message;
+		getErrorString(ret, message);
+		throw std::runtime_error(message);
+	}
+	reply.resize(ret);
+	return reply;
+}
+
+int hid_libusb::readHIDInto(std::vector<uint8_t>& buffer, int const timeout)
+{
+	// fills the buffer as is, a longer report is truncated to its size
+	int ret = readHID(buffer.data(), buffer.size(), timeout);
+	if (ret < 0) {
+		std::string message;
+		getErrorString(ret, message);
+		throw std::runtime_error(message);
+	}
+	return ret;
+}
+
+int hid_libusb::readBatch(hid_report_batch& batch, size_t const max_reports,
+                          int const timeout)
+{
+	batch.m_Data.resize(max_reports * m_InputReports.reportSize());
+	batch.m_Offsets.resize(max_reports);
+	batch.m_Lengths.resize(max_reports);
+	batch.m_Timestamps.resize(max_reports);
+	int ret = readHIDBatch(batch.m_Data.data(), batch.m_Data.size(),
+	                       batch.m_Offsets.data(), batch.m_Lengths.data(),
+	                       max_reports, timeout, batch.m_Timestamps.data());
+	size_t const reports = ret > 0 ? ret : 0;
+	batch.m_Offsets.resize(reports);
+	batch.m_Lengths.resize(reports);
+	batch.m_Timestamps.resize(reports);
+	batch.m_Data.resize(reports ? batch.m_Offsets[reports - 1] + batch.m_Lengths[reports - 1] : 0);
+	return ret;
+}
+
+hid_report_batch hid_libusb::readHIDBatch(size_t const max_reports,
+                                          int const timeout)
+{
+	hid_report_batch batch;
+	if (max_reports == 0)
+		return batch;
+
+	int ret = readBatch(batch, max_reports, timeout);
+	if (ret < 0) {
+		std::string message;
+		getErrorString(ret, message);
+		throw std::runtime_error(message);
+	}
+	return batch;
+}
+
+
+size_t hid_report_batch::size() const
+{
+	return m_Lengths.size();
+}
+
+std::vector<uint8_t> const& hid_report_batch::getData() const
+{
+	return m_Data;
+}
+
+std::vector<size_t> const& hid_report_batch::getOffsets() const
+{
+	return m_Offsets;
+}
+
+std::vector<size_t> const& hid_report_batch::getLengths() const
+{
+	return m_Lengths;
+}
+
+std::vector<uint64_t> const& hid_report_batch::getTimestamps() const
+{
+	return m_Timestamps;
+}
+
+std::vector<uint8_t> hid_report_batch::getReport(size_t const index) const
+{
+	if (index >= m_Lengths.size())
+		throw std::out_of_range("hid_report_batch::getReport: index out of range");
+	std::vector<uint8_t>::const_iterator begin = m_Data.begin() + m_Offsets[index];
+	return std::vector<uint8_t>(begin, begin + m_Lengths[index]);
+}
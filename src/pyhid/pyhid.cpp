@@ -509,6 +509,7 @@ pyhid_module::pyhid_module() : Py::ExtensionModule<pyhid_module>("pyhid"),
   d["HID_LIBUSB_NO_UDEV"]         = Py::Int(HID_LIBUSB_NO_UDEV);
   d["HID_LIBUSB_UDEV_MON_ERROR"]  = Py::Int(HID_LIBUSB_UDEV_MON_ERROR);
   d["HID_LIBUSB_UDEV_TIMEOUT"]    = Py::Int(HID_LIBUSB_UDEV_TIMEOUT);
+  d["HID_LIBUSB_DEVICE_BUSY"]     = Py::Int(HID_LIBUSB_DEVICE_BUSY);
   d["LIBUSB_SUCCESS"]             = Py::Int(LIBUSB_SUCCESS);
   d["LIBUSB_ERROR_IO"]            = Py::Int(LIBUSB_ERROR_IO);
   d["LIBUSB_ERROR_INVALID_PARAM"] = Py::Int(LIBUSB_ERROR_INVALID_PARAM);
@@ -0,0 +1,76 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2026 TU-Dresden  All rights reserved.
+//
+// Unless otherwise stated, the software on this site is distributed
+// in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+// without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. THERE IS NO WARRANTY FOR THE SOFTWARE,
+// TO THE EXTENT PERMITTED BY APPLICABLE LAW. EXCEPT WHEN OTHERWISE
+// STATED IN WRITING THE COPYRIGHT HOLDERS PROVIDE THE SOFTWARE
+// "AS IS" WITHOUT WARRANTY OF ANY KIND, EITHER EXPRESSED OR IMPLIED,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE ENTIRE
+// RISK AS TO THE QUALITY AND PERFORMANCE OF THE SOFTWARE IS WITH YOU.
+// SHOULD THE SOFTWARE PROVE DEFECTIVE, YOU ASSUME THE COST OF ALL
+// NECESSARY SERVICING, REPAIR OR CORRECTION. IN NO EVENT UNLESS
+// REQUIRED BY APPLICABLE LAW OR AGREED TO IN WRITING WILL ANY
+// COPYRIGHT HOLDER, BE LIABLE TO YOU FOR DAMAGES, INCLUDING ANY
+// GENERAL, SPECIAL, INCIDENTAL OR CONSEQUENTIAL DAMAGES ARISING OUT
+// OF THE USE OR INABILITY TO USE THE SOFTWARE (INCLUDING BUT NOT
+// LIMITED TO LOSS OF DATA OR DATA BEING RENDERED INACCURATE OR LOSSES
+// SUSTAINED BY YOU OR THIRD PARTIES OR A FAILURE OF THE SOFTWARE TO
+// OPERATE WITH ANY OTHER PROGRAMS), EVEN IF SUCH HOLDER HAS BEEN
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+//
+//-----------------------------------------------------------------
+
+// Company           :   TU-Dresden
+//
+// Filename          :   report_matcher.cpp
+// Project Name      :   PyHID
+// Description       :   Input report content matcher
+//-----------------------------------------------------------------
+#include "pyhid/report_matcher.hpp"
+
+#include <stdexcept>
+
+hid_report_matcher::hid_report_matcher() : m_Mask(),
+                                           m_Pattern()
+{
+}
+
+hid_report_matcher::hid_report_matcher(std::vector<uint8_t> const& mask,
+                                       std::vector<uint8_t> const& pattern)
+  : m_Mask(mask),
+    m_Pattern(pattern)
+{
+  if ( mask.size() != pattern.size() )
+    throw std::invalid_argument("hid_report_matcher: mask and pattern "
+                                "differ in length");
+
+  // bits outside the mask can never match, drop them from the pattern
+  for ( size_t i = 0; i < this->m_Mask.size(); i++ )
+    this->m_Pattern[i] &= this->m_Mask[i];
+}
+
+hid_report_matcher hid_report_matcher::reportID(const uint8_t uiReportID)
+{
+  return hid_report_matcher(std::vector<uint8_t>(1, 0xff),
+                            std::vector<uint8_t>(1, uiReportID));
+}
+
+bool hid_report_matcher::matches(std::vector<uint8_t> const& report) const
+{
+  return this->matches(report.data(), report.size());
+}
+
+std::vector<uint8_t> const& hid_report_matcher::getMask() const
+{
+  return this->m_Mask;
+}
+
+std::vector<uint8_t> const& hid_report_matcher::getPattern() const
+{
+  return this->m_Pattern;
+}
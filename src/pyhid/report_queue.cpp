@@ -0,0 +1,480 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2026 TU-Dresden  All rights reserved.
+//
+// Unless otherwise stated, the software on this site is distributed
+// in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+// without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. THERE IS NO WARRANTY FOR THE SOFTWARE,
+// TO THE EXTENT PERMITTED BY APPLICABLE LAW. EXCEPT WHEN OTHERWISE
+// STATED IN WRITING THE COPYRIGHT HOLDERS PROVIDE THE SOFTWARE
+// "AS IS" WITHOUT WARRANTY OF ANY KIND, EITHER EXPRESSED OR IMPLIED,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE ENTIRE
+// RISK AS TO THE QUALITY AND PERFORMANCE OF THE SOFTWARE IS WITH YOU.
+// SHOULD THE SOFTWARE PROVE DEFECTIVE, YOU ASSUME THE COST OF ALL
+// NECESSARY SERVICING, REPAIR OR CORRECTION. IN NO EVENT UNLESS
+// REQUIRED BY APPLICABLE LAW OR AGREED TO IN WRITING WILL ANY
+// COPYRIGHT HOLDER, BE LIABLE TO YOU FOR DAMAGES, INCLUDING ANY
+// GENERAL, SPECIAL, INCIDENTAL OR CONSEQUENTIAL DAMAGES ARISING OUT
+// OF THE USE OR INABILITY TO USE THE SOFTWARE (INCLUDING BUT NOT
+// LIMITED TO LOSS OF DATA OR DATA BEING RENDERED INACCURATE OR LOSSES
+// SUSTAINED BY YOU OR THIRD PARTIES OR A FAILURE OF THE SOFTWARE TO
+// OPERATE WITH ANY OTHER PROGRAMS), EVEN IF SUCH HOLDER HAS BEEN
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+//
+//-----------------------------------------------------------------
+
+// Company           :   TU-Dresden
+//
+// Filename          :   report_queue.cpp
+// Project Name      :   PyHID
+// Description       :   Lock-free input report queue
+//-----------------------------------------------------------------
+#include "pyhid/report_queue.hpp"
+#include "pyhid/hid_libusb.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+hid_report_queue::hid_report_queue() : m_uiHead(0),
+                                       m_uiTail(0),
+                                       m_iCredits(0),
+                                       m_uiDropped(0),
+                                       m_iWaiters(0),
+                                       m_iReaders(0),
+                                       m_bShutdown(false),
+                                       m_bDestroying(false),
+                                       m_iEventFd(-1),
+                                       m_pSlots(0),
+                                       m_puiStorage(0),
+                                       m_uiCapacity(0),
+                                       m_uiSlots(0),
+                                       m_uiSlotSize(0),
+                                       m_ePolicy(HID_OVERFLOW_DROP_OLDEST)
+{
+}
+
+hid_report_queue::~hid_report_queue()
+{
+  this->destroy();
+}
+
+int hid_report_queue::init(const size_t uiCapacity,
+                           const size_t uiMaxReportSize,
+                           const hid_overflow_policy ePolicy)
+{
+  // a report of 0 bytes is no report, the slots need room for one
+  if ( !uiCapacity || !uiMaxReportSize )
+    return HID_LIBUSB_INVALID_ARGS;
+
+  this->destroy();
+
+  size_t uiSlots = 1;
+  while ( uiSlots < uiCapacity )
+    uiSlots <<= 1;
+
+  size_t uiSlotSize = HID_LIBUSB_SLOT_ALIGNMENT;
+  while ( uiSlotSize < uiMaxReportSize )
+    uiSlotSize += HID_LIBUSB_SLOT_ALIGNMENT;
+
+  void *pStorage = 0;
+  if ( posix_memalign(&pStorage, HID_LIBUSB_SLOT_ALIGNMENT,
+                      uiSlots * uiSlotSize) )
+    return LIBUSB_ERROR_NO_MEM;
+
+  this->m_puiStorage = static_cast<uint8_t *>(pStorage);
+  this->m_pSlots = new report_slot_t[uiSlots];
+  for ( size_t i = 0; i < uiSlots; i++ )
+    {
+      this->m_pSlots[i].uiSequence.store(i);
+      this->m_pSlots[i].report.puiData = this->m_puiStorage + i * uiSlotSize;
+      this->m_pSlots[i].report.uiLength = 0;
+      this->m_pSlots[i].report.uiTimestamp = 0;
+    }
+  this->m_uiSlotSize = uiMaxReportSize;
+  this->m_uiCapacity = uiCapacity;
+  this->m_uiSlots = uiSlots;
+  this->m_ePolicy = ePolicy;
+  this->m_uiHead.store(0);
+  this->m_uiTail.store(0);
+  this->m_iCredits.store(uiCapacity);
+  this->m_uiDropped.store(0);
+  this->m_iWaiters.store(0);
+  this->m_bShutdown.store(false);
+  this->m_bDestroying.store(false);
+
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&this->m_Condition, &attr);
+  pthread_condattr_destroy(&attr);
+  pthread_mutex_init(&this->m_Mutex, 0);
+
+  return 0;
+}
+
+void hid_report_queue::destroy()
+{
+  if ( !this->m_pSlots )
+    return;
+
+  // readers woken by the shutdown may still be returning from
+  // pthread_cond_wait()
+  this->m_bDestroying.store(true);
+  this->shutdown();
+  while ( this->m_iReaders.load() > 0 )
+    sched_yield();
+
+  delete [] this->m_pSlots;
+  free(this->m_puiStorage);
+  if ( this->m_iEventFd >= 0 )
+    close(this->m_iEventFd);
+  this->m_iEventFd = -1;
+  this->m_pSlots = 0;
+  this->m_puiStorage = 0;
+  this->m_uiCapacity = 0;
+  this->m_uiSlots = 0;
+  this->m_uiSlotSize = 0;
+
+  pthread_cond_destroy(&this->m_Condition);
+  pthread_mutex_destroy(&this->m_Mutex);
+}
+
+bool hid_report_queue::empty() const
+{
+  return this->m_uiHead.load(std::memory_order_relaxed) ==
+    this->m_uiTail.load();
+}
+
+size_t hid_report_queue::size() const
+{
+  return this->m_uiTail.load() - this->m_uiHead.load();
+}
+
+bool hid_report_queue::reserve()
+{
+  long iCredits = this->m_iCredits.load();
+  while ( iCredits > 0 )
+    {
+      if ( this->m_iCredits.compare_exchange_weak(iCredits, iCredits - 1) )
+        return true;
+    }
+  return false;
+}
+
+void hid_report_queue::release()
+{
+  this->m_iCredits++;
+}
+
+void hid_report_queue::dropOldest(const size_t uiTail)
+{
+  size_t uiHead = this->m_uiHead.load();
+  if ( uiTail - uiHead < this->m_uiCapacity )
+    return;
+
+  report_slot_t *pSlot = &this->m_pSlots[uiHead & ( this->m_uiSlots - 1 )];
+  if ( pSlot->uiSequence.load(std::memory_order_acquire) != uiHead + 1 )
+    return;
+
+  // a reader claiming the same slot wins, it made room just the same
+  if ( !this->m_uiHead.compare_exchange_strong(uiHead, uiHead + 1) )
+    return;
+
+  pSlot->uiSequence.store(uiHead + this->m_uiSlots,
+                          std::memory_order_release);
+  this->m_uiDropped++;
+}
+
+bool hid_report_queue::push(const uint8_t *puiData, size_t uiLength,
+                            const uint64_t uiTimestamp)
+{
+  const size_t uiTail = this->m_uiTail.load(std::memory_order_relaxed);
+  report_slot_t *pSlot = &this->m_pSlots[uiTail & ( this->m_uiSlots - 1 )];
+
+  // Only readers move the head besides us, so every round either drops
+  // the oldest report or sees one taken by a reader.
+  while ( uiTail - this->m_uiHead.load(std::memory_order_acquire) >=
+          this->m_uiCapacity )
+    {
+      if ( this->m_ePolicy != HID_OVERFLOW_DROP_OLDEST )
+        {
+          this->m_uiDropped++;
+          return false;
+        }
+      this->dropOldest(uiTail);
+    }
+
+  // the slot is still being copied out by a reader
+  if ( pSlot->uiSequence.load(std::memory_order_acquire) != uiTail )
+    {
+      this->m_uiDropped++;
+      return false;
+    }
+
+  if ( uiLength > this->m_uiSlotSize )
+    uiLength = this->m_uiSlotSize;
+  memcpy(pSlot->report.puiData, puiData, uiLength);
+  pSlot->report.uiLength = uiLength;
+  pSlot->report.uiTimestamp = uiTimestamp;
+  pSlot->uiSequence.store(uiTail + 1, std::memory_order_release);
+
+  // Sequentially consistent so that either we see the reader announce
+  // itself in m_iWaiters or the reader sees the new tail before sleeping.
+  this->m_uiTail.store(uiTail + 1);
+  if ( this->m_uiHead.load() == uiTail )
+    this->signalEvent();
+  if ( this->m_iWaiters.load() > 0 )
+    {
+      pthread_mutex_lock(&this->m_Mutex);
+      pthread_cond_signal(&this->m_Condition);
+      pthread_mutex_unlock(&this->m_Mutex);
+    }
+
+  return true;
+}
+
+int hid_report_queue::copyReport(uint8_t *puiData, size_t uiLength,
+                                 uint64_t *puiTimestamp)
+{
+  size_t uiHead = this->m_uiHead.load();
+  report_slot_t *pSlot;
+  while ( true )
+    {
+      if ( uiHead == this->m_uiTail.load() )
+        return HID_LIBUSB_READ_ERROR;
+      pSlot = &this->m_pSlots[uiHead & ( this->m_uiSlots - 1 )];
+      if ( this->m_uiHead.compare_exchange_weak(uiHead, uiHead + 1) )
+        break;
+    }
+
+  const input_report_t *pReport = &pSlot->report;
+  size_t uiLen = ( uiLength < pReport->uiLength ) ?
+    uiLength : pReport->uiLength;
+
+  if ( uiLen > 0 && puiData )
+    memcpy(puiData, pReport->puiData, uiLen);
+  if ( puiTimestamp )
+    *puiTimestamp = pReport->uiTimestamp;
+  pSlot->uiSequence.store(uiHead + this->m_uiSlots,
+                          std::memory_order_release);
+  if ( this->m_ePolicy == HID_OVERFLOW_BLOCK )
+    this->m_iCredits++;
+  if ( uiHead + 1 == this->m_uiTail.load() )
+    this->clearEvent();
+
+  return uiLen;
+}
+
+bool hid_report_queue::enterReader()
+{
+  // Sequentially consistent, either destroy() waits for us or we see
+  // it coming and keep our hands off the queue.  A queue that is only
+  // shut down can still be drained.
+  this->m_iReaders.fetch_add(1);
+  if ( !this->m_bDestroying.load() )
+    return true;
+
+  this->m_iReaders.fetch_sub(1);
+  return false;
+}
+
+void hid_report_queue::cleanupMutex(void *pParam)
+{
+  self_type_t *pThis = static_cast<self_type_t *>(pParam);
+  pthread_mutex_unlock(&pThis->m_Mutex);
+  pThis->m_iReaders.fetch_sub(1);
+}
+
+int hid_report_queue::waitForReport(int iMilliseconds)
+{
+  if ( !this->empty() )
+    return 1;
+  if ( this->m_bShutdown.load() )
+    return HID_LIBUSB_READ_ERROR;
+  if ( iMilliseconds != -1 && iMilliseconds <= 0 )
+    return 0;
+
+  struct timespec ts;
+  if ( iMilliseconds > 0 )
+    {
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      ts.tv_sec += iMilliseconds / 1000;
+      ts.tv_nsec += ( iMilliseconds % 1000 ) * 1000000;
+      if ( ts.tv_nsec >= 1000000000L )
+        {
+          ts.tv_sec++;
+          ts.tv_nsec -= 1000000000L;
+        }
+    }
+
+  int iReady = 1;
+  this->m_iWaiters.fetch_add(1);
+  while ( this->empty() )
+    {
+      if ( this->m_bShutdown.load() )
+        {
+          iReady = HID_LIBUSB_READ_ERROR;
+          break;
+        }
+
+      int iResult;
+      if ( iMilliseconds == -1 )
+        iResult = pthread_cond_wait(&this->m_Condition, &this->m_Mutex);
+      else
+        iResult = pthread_cond_timedwait(&this->m_Condition,
+                                         &this->m_Mutex, &ts);
+      if ( iResult == ETIMEDOUT )
+        {
+          iReady = this->empty() ? 0 : 1;
+          break;
+        }
+      else if ( iResult )
+        {
+          iReady = HID_LIBUSB_READ_ERROR;
+          break;
+        }
+    }
+  this->m_iWaiters.fetch_sub(1);
+
+  return iReady;
+}
+
+int hid_report_queue::read(uint8_t *puiData, size_t uiLength,
+                           int iMilliseconds, uint64_t *puiTimestamp)
+{
+  int iBytesRead;
+
+  if ( !this->enterReader() )
+    return HID_LIBUSB_READ_ERROR;
+
+  pthread_mutex_lock(&this->m_Mutex);
+  pthread_cleanup_push(&self_type_t::cleanupMutex, this);
+
+  // copyReport() only fails here if the producer retired the report
+  // between waking us and the copy
+  while ( ( iBytesRead = this->waitForReport(iMilliseconds) ) > 0 &&
+          ( iBytesRead = this->copyReport(puiData, uiLength,
+                                          puiTimestamp) ) < 0 )
+    ;
+
+  pthread_mutex_unlock(&this->m_Mutex);
+  pthread_cleanup_pop(0);
+  // the queue may be destroyed from here on
+  this->m_iReaders.fetch_sub(1);
+
+  return iBytesRead;
+}
+
+int hid_report_queue::readBatch(uint8_t *puiData, size_t uiLength,
+                                size_t *puiOffsets, size_t *puiLengths,
+                                size_t uiMaxReports, int iMilliseconds,
+                                uint64_t *puiTimestamps)
+{
+  int iReports = 0;
+
+  if ( !this->enterReader() )
+    return HID_LIBUSB_READ_ERROR;
+
+  pthread_mutex_lock(&this->m_Mutex);
+  pthread_cleanup_push(&self_type_t::cleanupMutex, this);
+
+  int iResult = this->waitForReport(iMilliseconds);
+  if ( iResult > 0 )
+    {
+      // Reports are packed back to back, stop before one might not fit.
+      // Only a single report is truncated to a too small buffer.
+      size_t uiOffset = 0;
+      while ( (size_t)iReports < uiMaxReports &&
+              ( !iReports || uiLength - uiOffset >= this->m_uiSlotSize ) )
+        {
+          const int iBytesRead =
+            this->copyReport(puiData + uiOffset, uiLength - uiOffset,
+                             puiTimestamps ? &puiTimestamps[iReports] : 0);
+          if ( iBytesRead < 0 )
+            break;
+          puiOffsets[iReports] = uiOffset;
+          puiLengths[iReports] = iBytesRead;
+          uiOffset += iBytesRead;
+          iReports++;
+        }
+    }
+  else
+    iReports = iResult;
+
+  pthread_mutex_unlock(&this->m_Mutex);
+  pthread_cleanup_pop(0);
+  this->m_iReaders.fetch_sub(1);
+
+  return iReports;
+}
+
+void hid_report_queue::signalEvent()
+{
+  const int iFd = this->m_iEventFd.load(std::memory_order_acquire);
+  if ( iFd < 0 )
+    return;
+
+  const uint64_t uiValue = 1;
+  if ( write(iFd, &uiValue, sizeof(uiValue)) < 0 )
+    return;
+}
+
+void hid_report_queue::clearEvent()
+{
+  const int iFd = this->m_iEventFd.load(std::memory_order_relaxed);
+  if ( iFd < 0 || this->m_bShutdown.load() )
+    return;
+
+  uint64_t uiValue;
+  if ( ::read(iFd, &uiValue, sizeof(uiValue)) < 0 )
+    return;
+
+  // a report published while we were clearing must stay visible
+  if ( !this->empty() )
+    this->signalEvent();
+}
+
+int hid_report_queue::eventFD()
+{
+  if ( !this->m_pSlots )
+    return HID_LIBUSB_NO_DEVICE_OPEN;
+
+  int iFd = this->m_iEventFd.load();
+  if ( iFd >= 0 )
+    return iFd;
+
+  pthread_mutex_lock(&this->m_Mutex);
+  iFd = this->m_iEventFd.load();
+  if ( iFd < 0 )
+    {
+      iFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      if ( iFd < 0 )
+        iFd = LIBUSB_ERROR_OTHER;
+      else
+        {
+          this->m_iEventFd.store(iFd);
+          if ( !this->empty() || this->m_bShutdown.load() )
+            this->signalEvent();
+        }
+    }
+  pthread_mutex_unlock(&this->m_Mutex);
+
+  return iFd;
+}
+
+void hid_report_queue::shutdown()
+{
+  this->m_bShutdown.store(true);
+  this->signalEvent();
+
+  pthread_mutex_lock(&this->m_Mutex);
+  pthread_cond_broadcast(&this->m_Condition);
+  pthread_mutex_unlock(&this->m_Mutex);
+}
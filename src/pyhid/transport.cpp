@@ -0,0 +1,578 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2026 TU-Dresden  All rights reserved.
+//
+// Unless otherwise stated, the software on this site is distributed
+// in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+// without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. THERE IS NO WARRANTY FOR THE SOFTWARE,
+// TO THE EXTENT PERMITTED BY APPLICABLE LAW. EXCEPT WHEN OTHERWISE
+// STATED IN WRITING THE COPYRIGHT HOLDERS PROVIDE THE SOFTWARE
+// "AS IS" WITHOUT WARRANTY OF ANY KIND, EITHER EXPRESSED OR IMPLIED,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE ENTIRE
+// RISK AS TO THE QUALITY AND PERFORMANCE OF THE SOFTWARE IS WITH YOU.
+// SHOULD THE SOFTWARE PROVE DEFECTIVE, YOU ASSUME THE COST OF ALL
+// NECESSARY SERVICING, REPAIR OR CORRECTION. IN NO EVENT UNLESS
+// REQUIRED BY APPLICABLE LAW OR AGREED TO IN WRITING WILL ANY
+// COPYRIGHT HOLDER, BE LIABLE TO YOU FOR DAMAGES, INCLUDING ANY
+// GENERAL, SPECIAL, INCIDENTAL OR CONSEQUENTIAL DAMAGES ARISING OUT
+// OF THE USE OR INABILITY TO USE THE SOFTWARE (INCLUDING BUT NOT
+// LIMITED TO LOSS OF DATA OR DATA BEING RENDERED INACCURATE OR LOSSES
+// SUSTAINED BY YOU OR THIRD PARTIES OR A FAILURE OF THE SOFTWARE TO
+// OPERATE WITH ANY OTHER PROGRAMS), EVEN IF SUCH HOLDER HAS BEEN
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+//
+//-----------------------------------------------------------------
+
+// Company           :   TU-Dresden
+//
+// Filename          :   transport.cpp
+// Project Name      :   PyHID
+// Description       :   Transfer primitives of libusb and emulated devices
+//-----------------------------------------------------------------
+#include "pyhid/transport.hpp"
+#include "pyhid/hid_libusb.hpp"
+
+#include <string.h>
+
+static uint64_t toNanoseconds(const struct timespec &ts)
+{
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void fromNanoseconds(const uint64_t uiNanoseconds, struct timespec *pTs)
+{
+  pTs->tv_sec = uiNanoseconds / 1000000000ULL;
+  pTs->tv_nsec = uiNanoseconds % 1000000000ULL;
+}
+
+static uint64_t monotonicNow()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return toNanoseconds(now);
+}
+
+hid_libusb_transport::hid_libusb_transport(libusb_context *pContext,
+                                           libusb_device_handle *pDeviceHandle,
+                                           const size_t uiReportSize,
+                                           std::string const& name)
+  : m_pContext(pContext),
+    m_pDeviceHandle(pDeviceHandle),
+    m_uiReportSize(uiReportSize),
+    m_Name(name)
+{
+}
+
+struct libusb_transfer *hid_libusb_transport::allocTransfer()
+{
+  return libusb_wrapper::getInstance().libusbAllocTransfer(0);
+}
+
+void hid_libusb_transport::freeTransfer(struct libusb_transfer *pTransfer)
+{
+  libusb_wrapper::getInstance().libusbFreeTransfer(pTransfer);
+}
+
+int hid_libusb_transport::submitTransfer(struct libusb_transfer *pTransfer)
+{
+  return libusb_wrapper::getInstance().libusbSubmitTransfer(pTransfer);
+}
+
+int hid_libusb_transport::cancelTransfer(struct libusb_transfer *pTransfer)
+{
+  return libusb_wrapper::getInstance().libusbCancelTransfer(pTransfer);
+}
+
+int hid_libusb_transport::handleEvents(struct timeval *pTimeout)
+{
+  return libusb_wrapper::getInstance().libusbHandleEventsTimeout(
+                 this->m_pContext, pTimeout);
+}
+
+int hid_libusb_transport::controlTransfer(const uint8_t uiRequestType,
+                                          const uint8_t uiRequest,
+                                          const uint16_t uiValue,
+                                          const uint16_t uiIndex,
+                                          uint8_t *puiData,
+                                          const uint16_t uiLength,
+                                          const unsigned int uiTimeout)
+{
+  return libusb_wrapper::getInstance().libusbControlTransfer(
+                 this->m_pDeviceHandle, uiRequestType, uiRequest, uiValue,
+                 uiIndex, puiData, uiLength, uiTimeout);
+}
+
+size_t hid_libusb_transport::reportSize() const
+{
+  return this->m_uiReportSize;
+}
+
+std::string hid_libusb_transport::getName() const
+{
+  return this->m_Name;
+}
+
+hid_emulated_transport::hid_emulated_transport(const size_t uiReportSize,
+                                               const bool bWritable,
+                                               const bool bEcho)
+  : m_uiReportSize(uiReportSize),
+    m_bWritable(bWritable),
+    m_bGone(false),
+    m_Echoes(bEcho ? HID_MOCK_ECHO_DEPTH * uiReportSize : 0),
+    m_EchoLengths(bEcho ? HID_MOCK_ECHO_DEPTH : 0),
+    m_uiEchoHead(0),
+    m_uiEchoCount(0),
+    m_bEcho(bEcho)
+{
+  this->m_Input.pHead = this->m_Input.pTail = 0;
+  this->m_Output.pHead = this->m_Output.pTail = 0;
+
+  // transfers wait for their deadline, reports for the time they are due
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&this->m_Condition, &attr);
+  pthread_condattr_destroy(&attr);
+  pthread_mutex_init(&this->m_Mutex, 0);
+}
+
+hid_emulated_transport::~hid_emulated_transport()
+{
+  pthread_cond_destroy(&this->m_Condition);
+  pthread_mutex_destroy(&this->m_Mutex);
+}
+
+hid_emulated_transport::emulated_transfer_t *
+hid_emulated_transport::fromTransfer(struct libusb_transfer *pTransfer)
+{
+  return reinterpret_cast<emulated_transfer_t *>(
+           reinterpret_cast<uint8_t *>(pTransfer) -
+           offsetof(emulated_transfer_t, transfer));
+}
+
+void hid_emulated_transport::append(transfer_list_t *pList,
+                                    emulated_transfer_t *pTransfer)
+{
+  pTransfer->pNext = 0;
+  if ( pList->pTail )
+    pList->pTail->pNext = pTransfer;
+  else
+    pList->pHead = pTransfer;
+  pList->pTail = pTransfer;
+}
+
+hid_emulated_transport::emulated_transfer_t *
+hid_emulated_transport::take(transfer_list_t *pList)
+{
+  emulated_transfer_t *pTransfer = pList->pHead;
+  pList->pHead = pTransfer->pNext;
+  if ( !pList->pHead )
+    pList->pTail = 0;
+  return pTransfer;
+}
+
+void hid_emulated_transport::finish(emulated_transfer_t *pTransfer,
+                                    const libusb_transfer_status eStatus,
+                                    transfer_list_t *pDone)
+{
+  pTransfer->bPending = false;
+  pTransfer->transfer.status = eStatus;
+  append(pDone, pTransfer);
+}
+
+struct libusb_transfer *hid_emulated_transport::allocTransfer()
+{
+  emulated_transfer_t *pTransfer = new emulated_transfer_t();
+  return &pTransfer->transfer;
+}
+
+void hid_emulated_transport::freeTransfer(struct libusb_transfer *pTransfer)
+{
+  if ( pTransfer )
+    delete fromTransfer(pTransfer);
+}
+
+int hid_emulated_transport::submitTransfer(struct libusb_transfer *pTransfer)
+{
+  const bool bInput =
+    ( pTransfer->endpoint & LIBUSB_ENDPOINT_DIR_MASK ) == LIBUSB_ENDPOINT_IN;
+  if ( pTransfer->type != LIBUSB_TRANSFER_TYPE_INTERRUPT ||
+       ( !bInput && !this->m_bWritable ) )
+    return LIBUSB_ERROR_NOT_SUPPORTED;
+
+  emulated_transfer_t *pEmulated = fromTransfer(pTransfer);
+
+  pthread_mutex_lock(&this->m_Mutex);
+  if ( this->m_bGone )
+    {
+      pthread_mutex_unlock(&this->m_Mutex);
+      return LIBUSB_ERROR_NO_DEVICE;
+    }
+  pEmulated->uiDeadline = pTransfer->timeout ?
+    monotonicNow() + pTransfer->timeout * 1000000ULL : 0;
+  pEmulated->bPending = true;
+  pEmulated->bCancelled = false;
+  pTransfer->actual_length = 0;
+  append(bInput ? &this->m_Input : &this->m_Output, pEmulated);
+  pthread_cond_signal(&this->m_Condition);
+  pthread_mutex_unlock(&this->m_Mutex);
+
+  return 0;
+}
+
+int hid_emulated_transport::cancelTransfer(struct libusb_transfer *pTransfer)
+{
+  emulated_transfer_t *pEmulated = fromTransfer(pTransfer);
+
+  int iResult = LIBUSB_ERROR_NOT_FOUND;
+  pthread_mutex_lock(&this->m_Mutex);
+  if ( pEmulated->bPending && !pEmulated->bCancelled )
+    {
+      pEmulated->bCancelled = true;
+      pthread_cond_signal(&this->m_Condition);
+      iResult = 0;
+    }
+  pthread_mutex_unlock(&this->m_Mutex);
+
+  return iResult;
+}
+
+void hid_emulated_transport::expire(transfer_list_t *pList,
+                                    const uint64_t uiNow,
+                                    uint64_t *puiWake,
+                                    transfer_list_t *pDone)
+{
+  emulated_transfer_t **ppLink = &pList->pHead;
+  emulated_transfer_t *pPrevious = 0;
+  while ( *ppLink )
+    {
+      emulated_transfer_t *pTransfer = *ppLink;
+      libusb_transfer_status eStatus;
+      if ( pTransfer->bCancelled )
+        eStatus = LIBUSB_TRANSFER_CANCELLED;
+      else if ( this->m_bGone )
+        eStatus = LIBUSB_TRANSFER_NO_DEVICE;
+      else if ( pTransfer->uiDeadline && pTransfer->uiDeadline <= uiNow )
+        eStatus = LIBUSB_TRANSFER_TIMED_OUT;
+      else
+        {
+          if ( pTransfer->uiDeadline &&
+               ( !*puiWake || pTransfer->uiDeadline < *puiWake ) )
+            *puiWake = pTransfer->uiDeadline;
+          pPrevious = pTransfer;
+          ppLink = &pTransfer->pNext;
+          continue;
+        }
+
+      *ppLink = pTransfer->pNext;
+      if ( pList->pTail == pTransfer )
+        pList->pTail = pPrevious;
+      finish(pTransfer, eStatus, pDone);
+    }
+}
+
+uint64_t hid_emulated_transport::collect(const uint64_t uiNow,
+                                         transfer_list_t *pDone)
+{
+  // earliest time something may change without being woken up
+  uint64_t uiWake = 0;
+
+  this->expire(&this->m_Input, uiNow, &uiWake, pDone);
+  this->expire(&this->m_Output, uiNow, &uiWake, pDone);
+
+  bool bMoved = true;
+  while ( bMoved )
+    {
+      bMoved = false;
+
+      // written reports are taken right away, echoes once there is room
+      while ( this->m_Output.pHead &&
+              ( !this->m_bEcho || this->m_uiEchoCount < HID_MOCK_ECHO_DEPTH ) )
+        {
+          emulated_transfer_t *pTransfer = take(&this->m_Output);
+          if ( this->m_bEcho )
+            {
+              const size_t uiSlot = ( this->m_uiEchoHead + this->m_uiEchoCount ) %
+                HID_MOCK_ECHO_DEPTH;
+              size_t uiLength = pTransfer->transfer.length;
+              if ( uiLength > this->m_uiReportSize )
+                uiLength = this->m_uiReportSize;
+              memcpy(&this->m_Echoes[uiSlot * this->m_uiReportSize],
+                     pTransfer->transfer.buffer, uiLength);
+              this->m_EchoLengths[uiSlot] = uiLength;
+              this->m_uiEchoCount++;
+            }
+          pTransfer->transfer.actual_length = pTransfer->transfer.length;
+          finish(pTransfer, LIBUSB_TRANSFER_COMPLETED, pDone);
+        }
+
+      // echoes first, somebody may be waiting for them
+      while ( this->m_Input.pHead && this->m_uiEchoCount )
+        {
+          emulated_transfer_t *pTransfer = take(&this->m_Input);
+          const size_t uiSlot = this->m_uiEchoHead;
+          size_t uiLength = this->m_EchoLengths[uiSlot];
+          if ( uiLength > (size_t)pTransfer->transfer.length )
+            uiLength = pTransfer->transfer.length;
+          memcpy(pTransfer->transfer.buffer,
+                 &this->m_Echoes[uiSlot * this->m_uiReportSize], uiLength);
+          this->m_uiEchoHead = ( uiSlot + 1 ) % HID_MOCK_ECHO_DEPTH;
+          this->m_uiEchoCount--;
+          pTransfer->transfer.actual_length = uiLength;
+          finish(pTransfer, LIBUSB_TRANSFER_COMPLETED, pDone);
+          bMoved = this->m_Output.pHead != 0;
+        }
+    }
+
+  while ( this->m_Input.pHead )
+    {
+      emulated_transfer_t *pTransfer = this->m_Input.pHead;
+      size_t uiLength = pTransfer->transfer.length;
+      struct timespec due;
+      const int iResult = this->nextReport(pTransfer->transfer.buffer,
+                                           &uiLength, &due);
+      if ( iResult < 0 )
+        {
+          // unplugged, whatever is pending fails
+          this->m_bGone = true;
+          this->expire(&this->m_Input, uiNow, &uiWake, pDone);
+          this->expire(&this->m_Output, uiNow, &uiWake, pDone);
+          break;
+        }
+      if ( !iResult )
+        {
+          const uint64_t uiDue = toNanoseconds(due);
+          if ( !uiWake || uiDue < uiWake )
+            uiWake = uiDue;
+          break;
+        }
+
+      take(&this->m_Input);
+      pTransfer->transfer.actual_length = uiLength;
+      finish(pTransfer, LIBUSB_TRANSFER_COMPLETED, pDone);
+    }
+
+  return uiWake;
+}
+
+int hid_emulated_transport::handleEvents(struct timeval *pTimeout)
+{
+  uint64_t uiNow = monotonicNow();
+  const uint64_t uiDeadline = uiNow + ( pTimeout ?
+    pTimeout->tv_sec * 1000000000ULL + pTimeout->tv_usec * 1000ULL : 0 );
+
+  transfer_list_t done;
+  done.pHead = done.pTail = 0;
+
+  pthread_mutex_lock(&this->m_Mutex);
+  while ( true )
+    {
+      const uint64_t uiWake = this->collect(uiNow, &done);
+      if ( done.pHead || uiNow >= uiDeadline )
+        break;
+
+      struct timespec wake;
+      fromNanoseconds(( uiWake && uiWake < uiDeadline ) ? uiWake : uiDeadline,
+                      &wake);
+      pthread_cond_timedwait(&this->m_Condition, &this->m_Mutex, &wake);
+      uiNow = monotonicNow();
+    }
+  pthread_mutex_unlock(&this->m_Mutex);
+
+  // outside the lock, a callback usually submits its transfer again
+  emulated_transfer_t *pTransfer = done.pHead;
+  while ( pTransfer )
+    {
+      emulated_transfer_t *pNext = pTransfer->pNext;
+      pTransfer->transfer.callback(&pTransfer->transfer);
+      pTransfer = pNext;
+    }
+
+  return 0;
+}
+
+int hid_emulated_transport::controlTransfer(const uint8_t uiRequestType,
+                                            const uint8_t,
+                                            const uint16_t,
+                                            const uint16_t,
+                                            uint8_t *,
+                                            const uint16_t uiLength,
+                                            const unsigned int)
+{
+  pthread_mutex_lock(&this->m_Mutex);
+  const bool bGone = this->m_bGone;
+  pthread_mutex_unlock(&this->m_Mutex);
+  if ( bGone )
+    return LIBUSB_ERROR_NO_DEVICE;
+
+  // feature reports are taken, there are none to read back
+  if ( ( uiRequestType & LIBUSB_ENDPOINT_DIR_MASK ) == LIBUSB_ENDPOINT_OUT &&
+       this->m_bWritable )
+    return uiLength;
+
+  return LIBUSB_ERROR_NOT_SUPPORTED;
+}
+
+size_t hid_emulated_transport::reportSize() const
+{
+  return this->m_uiReportSize;
+}
+
+hid_replay_transport::hid_replay_transport(const hid_replay_speed eSpeed,
+                                           const double dScale,
+                                           const int iDevice)
+  : hid_emulated_transport(HID_LIBUSB_REPLAY_REPORT_SIZE, false, false),
+    m_Reader(),
+    m_Path(),
+    m_eSpeed(eSpeed),
+    m_dScale(( eSpeed == HID_REPLAY_SCALED ) ? dScale : 1.0),
+    m_iDevice(iDevice),
+    m_Payload(),
+    m_bPending(false),
+    m_bStarted(false),
+    m_uiFirst(0)
+{
+}
+
+int hid_replay_transport::open(std::string const& path)
+{
+  this->m_Path = path;
+  return this->m_Reader.open(path);
+}
+
+int hid_replay_transport::nextReport(uint8_t *puiData, size_t *puiLength,
+                                     struct timespec *pDue)
+{
+  while ( !this->m_bPending )
+    {
+      const int iResult = this->m_Reader.read(this->m_Record, this->m_Payload);
+      if ( iResult < 0 )
+        return iResult;
+      if ( !iResult )
+        return HID_LIBUSB_READ_ERROR;
+      this->m_bPending = this->m_Record.uiKind == HID_CAPTURE_INPUT &&
+        ( this->m_iDevice < 0 || this->m_Record.uiDevice == this->m_iDevice );
+    }
+
+  if ( this->m_eSpeed != HID_REPLAY_FAST )
+    {
+      struct timespec now;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      if ( !this->m_bStarted )
+        {
+          this->m_Start = now;
+          this->m_uiFirst = this->m_Record.uiTimestamp;
+          this->m_bStarted = true;
+        }
+
+      // reports keep their distance in time, divided by the scale
+      const uint64_t uiDelay = ( this->m_Record.uiTimestamp > this->m_uiFirst ) ?
+        ( this->m_Record.uiTimestamp - this->m_uiFirst ) / this->m_dScale : 0;
+      const uint64_t uiDue = toNanoseconds(this->m_Start) + uiDelay;
+      if ( toNanoseconds(now) < uiDue )
+        {
+          fromNanoseconds(uiDue, pDue);
+          return 0;
+        }
+    }
+
+  if ( *puiLength > this->m_Payload.size() )
+    *puiLength = this->m_Payload.size();
+  memcpy(puiData, this->m_Payload.data(), *puiLength);
+  this->m_bPending = false;
+
+  return 1;
+}
+
+std::string hid_replay_transport::getName() const
+{
+  return this->m_Path;
+}
+
+hid_mock_transport::hid_mock_transport(const double dRate,
+                                       const size_t uiReportSize,
+                                       const uint32_t uiJitterUs,
+                                       const uint64_t uiReports,
+                                       const bool bEcho,
+                                       const uint8_t uiReportID)
+  : hid_emulated_transport(uiReportSize, true, bEcho),
+    m_dRate(dRate),
+    m_uiJitterUs(uiJitterUs),
+    m_uiReports(uiReports),
+    m_uiReportID(uiReportID),
+    m_uiGenerated(0),
+    m_uiRandom(0x9e3779b97f4a7c15ULL),
+    m_uiJitter(0),
+    m_bStarted(false)
+{
+}
+
+uint32_t hid_mock_transport::nextRandom()
+{
+  // xorshift64*, the same jitter on every run
+  this->m_uiRandom ^= this->m_uiRandom >> 12;
+  this->m_uiRandom ^= this->m_uiRandom << 25;
+  this->m_uiRandom ^= this->m_uiRandom >> 27;
+  return ( this->m_uiRandom * 0x2545f4914f6cdd1dULL ) >> 32;
+}
+
+int hid_mock_transport::nextReport(uint8_t *puiData, size_t *puiLength,
+                                   struct timespec *pDue)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if ( !this->m_bStarted )
+    {
+      this->m_Start = now;
+      this->m_bStarted = true;
+      if ( this->m_uiJitterUs )
+        this->m_uiJitter = this->nextRandom() % ( this->m_uiJitterUs * 1000ULL + 1 );
+    }
+
+  if ( this->m_uiGenerated >= this->m_uiReports )
+    {
+      if ( !this->m_bEcho )
+        return HID_LIBUSB_READ_ERROR;
+      // only echoes are left, a write wakes us up
+      fromNanoseconds(toNanoseconds(now) + 1000000000ULL, pDue);
+      return 0;
+    }
+
+  uint64_t uiTime = toNanoseconds(now);
+  if ( this->m_dRate > 0 )
+    {
+      const uint64_t uiDue = toNanoseconds(this->m_Start) +
+        (uint64_t)( this->m_uiGenerated * 1e9 / this->m_dRate ) +
+        this->m_uiJitter;
+      if ( uiTime < uiDue )
+        {
+          fromNanoseconds(uiDue, pDue);
+          return 0;
+        }
+      uiTime = uiDue;
+    }
+
+  if ( *puiLength > this->reportSize() )
+    *puiLength = this->reportSize();
+  memset(puiData, 0, *puiLength);
+  const uint32_t uiSequence = this->m_uiGenerated;
+  if ( *puiLength >= 1 )
+    puiData[0] = this->m_uiReportID;
+  if ( *puiLength >= 1 + sizeof(uiSequence) )
+    memcpy(puiData + 1, &uiSequence, sizeof(uiSequence));
+  if ( *puiLength >= 1 + sizeof(uiSequence) + sizeof(uiTime) )
+    memcpy(puiData + 1 + sizeof(uiSequence), &uiTime, sizeof(uiTime));
+
+  this->m_uiGenerated++;
+  if ( this->m_uiJitterUs )
+    this->m_uiJitter = this->nextRandom() % ( this->m_uiJitterUs * 1000ULL + 1 );
+
+  return 1;
+}
+
+std::string hid_mock_transport::getName() const
+{
+  return "mock";
+}
@@ -0,0 +1,92 @@
+//-----------------------------------------------------------------
+//
+// Copyright (c) 2026 TU-Dresden  All rights reserved.
+//
+// Unless otherwise stated, the software on this site is distributed
+// in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+// without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. THERE IS NO WARRANTY FOR THE SOFTWARE,
+// TO THE EXTENT PERMITTED BY APPLICABLE LAW. EXCEPT WHEN OTHERWISE
+// STATED IN WRITING THE COPYRIGHT HOLDERS PROVIDE THE SOFTWARE
+// "AS IS" WITHOUT WARRANTY OF ANY KIND, EITHER EXPRESSED OR IMPLIED,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE ENTIRE
+// RISK AS TO THE QUALITY AND PERFORMANCE OF THE SOFTWARE IS WITH YOU.
+// SHOULD THE SOFTWARE PROVE DEFECTIVE, YOU ASSUME THE COST OF ALL
+// NECESSARY SERVICING, REPAIR OR CORRECTION. IN NO EVENT UNLESS
+// REQUIRED BY APPLICABLE LAW OR AGREED TO IN WRITING WILL ANY
+// COPYRIGHT HOLDER, BE LIABLE TO YOU FOR DAMAGES, INCLUDING ANY
+// GENERAL, SPECIAL, INCIDENTAL OR CONSEQUENTIAL DAMAGES ARISING OUT
+// OF THE USE OR INABILITY TO USE THE SOFTWARE (INCLUDING BUT NOT
+// LIMITED TO LOSS OF DATA OR DATA BEING RENDERED INACCURATE OR LOSSES
+// SUSTAINED BY YOU OR THIRD PARTIES OR A FAILURE OF THE SOFTWARE TO
+// OPERATE WITH ANY OTHER PROGRAMS), EVEN IF SUCH HOLDER HAS BEEN
+// ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+//
+//-----------------------------------------------------------------
+
+// Company           :   TU-Dresden
+//
+// Filename          :   write_queue.cpp
+// Project Name      :   PyHID
+// Description       :   Lock-free output report queue
+//-----------------------------------------------------------------
+#include "pyhid/write_queue.hpp"
+
+hid_write_queue::hid_write_queue() : m_pBack(&m_Stub),
+                                     m_pFront(&m_Stub),
+                                     m_uiSize(0)
+{
+  this->m_Stub.pNext = 0;
+}
+
+void hid_write_queue::link(write_request_t *pRequest)
+{
+  pRequest->pNext.store(0, std::memory_order_relaxed);
+  write_request_t *pPrev = this->m_pBack.exchange(pRequest);
+  pPrev->pNext.store(pRequest, std::memory_order_release);
+}
+
+void hid_write_queue::push(write_request_t *pRequest)
+{
+  this->m_uiSize++;
+  this->link(pRequest);
+}
+
+write_request_t *hid_write_queue::pop()
+{
+  write_request_t *pFront = this->m_pFront;
+  write_request_t *pNext = pFront->pNext.load(std::memory_order_acquire);
+
+  if ( pFront == &this->m_Stub )
+    {
+      if ( !pNext )
+        return 0;
+      this->m_pFront = pNext;
+      pFront = pNext;
+      pNext = pNext->pNext.load(std::memory_order_acquire);
+    }
+
+  if ( pNext )
+    {
+      this->m_pFront = pNext;
+      this->m_uiSize--;
+      return pFront;
+    }
+
+  // a producer is between swapping the back and linking it
+  if ( pFront != this->m_pBack.load() )
+    return 0;
+
+  // pFront is the last report, put the stub behind it so it can be taken
+  this->link(&this->m_Stub);
+  pNext = pFront->pNext.load(std::memory_order_acquire);
+  if ( pNext )
+    {
+      this->m_pFront = pNext;
+      this->m_uiSize--;
+      return pFront;
+    }
+
+  return 0;
+}
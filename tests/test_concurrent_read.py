@@ -0,0 +1,125 @@
+#!/usr/bin/env python
+"""
+Reads several mock devices from several Python threads at once and
+closes the devices while the readers are blocked, see
+hid_libusb::openMock().  No report may be read twice, with lossless
+backpressure none may be skipped either, and every reader has to come
+back with an error once its device is closed.
+"""
+import struct
+import threading
+import time
+import unittest
+
+import pyhid
+
+DEVICES = 4
+READERS = 3
+REPORT_SIZE = 16
+RATE = 2000.0
+DURATION = 0.5
+JOIN_TIMEOUT = 5.0
+
+
+def sequence(report):
+    # the mock puts its report ID first, then a little endian counter
+    return struct.unpack_from("<I", report, 1)[0]
+
+
+class ConcurrentReadTest(unittest.TestCase):
+
+    def open_devices(self, policy):
+        devices = []
+        for _ in range(DEVICES):
+            device = pyhid.pyhidaccess()
+            self.assertEqual(device.setOverflowPolicy(policy), 0)
+            self.assertEqual(device.openMock(RATE, REPORT_SIZE, 0, 0xffffffffffffffff, False), 0)
+            devices.append(device)
+        return devices
+
+    def read_until_closed(self, policy):
+        devices = self.open_devices(policy)
+        seen = [[] for _ in devices]
+        errors = []
+        lock = threading.Lock()
+
+        def reader(index, batch):
+            device = devices[index]
+            got = []
+            try:
+                while True:
+                    if batch:
+                        reports = device.readHIDBatch(8, -1)
+                        got.extend(sequence(reports.getReport(i)) for i in range(len(reports)))
+                    else:
+                        got.append(sequence(device.readHID(REPORT_SIZE, -1)))
+            except RuntimeError:
+                # closeHID() ends the read
+                pass
+            except Exception as e:
+                errors.append(e)
+            with lock:
+                seen[index].extend(got)
+
+        threads = []
+        for index in range(len(devices)):
+            for r in range(READERS):
+                thread = threading.Thread(target=reader, args=(index, r == READERS - 1))
+                thread.daemon = True
+                thread.start()
+                threads.append(thread)
+
+        time.sleep(DURATION)
+        for device in devices:
+            device.closeHID()
+        for thread in threads:
+            thread.join(JOIN_TIMEOUT)
+            self.assertFalse(thread.is_alive(), "reader still blocked after closeHID()")
+
+        self.assertEqual(errors, [])
+        for got in seen:
+            self.assertTrue(got, "no reports read")
+            self.assertEqual(len(got), len(set(got)), "report read twice")
+            if policy == pyhid.hid_overflow_policy.HID_OVERFLOW_BLOCK:
+                self.assertEqual(sorted(got), list(range(len(got))), "report skipped")
+
+    def test_drop_oldest(self):
+        self.read_until_closed(pyhid.hid_overflow_policy.HID_OVERFLOW_DROP_OLDEST)
+
+    def test_block(self):
+        self.read_until_closed(pyhid.hid_overflow_policy.HID_OVERFLOW_BLOCK)
+
+    def test_close_during_read(self):
+        # readers stay blocked on a device without reports until it
+        # closes, an echo device only sends what is written to it
+        devices = []
+        for _ in range(DEVICES):
+            device = pyhid.pyhidaccess()
+            self.assertEqual(device.openMock(0, REPORT_SIZE, 0, 0, True), 0)
+            devices.append(device)
+
+        done = []
+
+        def reader(device):
+            try:
+                device.readHID(REPORT_SIZE, -1)
+            except RuntimeError:
+                done.append(device)
+
+        threads = [threading.Thread(target=reader, args=(device,))
+                   for device in devices for _ in range(READERS)]
+        for thread in threads:
+            thread.daemon = True
+            thread.start()
+        time.sleep(0.1)
+        self.assertEqual(done, [])
+        for device in devices:
+            device.closeHID()
+        for thread in threads:
+            thread.join(JOIN_TIMEOUT)
+            self.assertFalse(thread.is_alive(), "reader still blocked after closeHID()")
+        self.assertEqual(len(done), len(threads))
+
+
+if __name__ == "__main__":
+    unittest.main()